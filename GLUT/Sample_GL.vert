@@ -4,19 +4,31 @@
 layout (location = 0) in vec3 vertexPosition;
 layout (location = 1) in vec3 vertexColor;
 
-uniform mat4 MVP;
+// view-projection, shared by every draw and changed only when the camera moves
+layout (std140) uniform Camera {
+    mat4 VP;
+};
+
+// per draw : x, y offset, rotation (radians), x scale
+uniform vec4 Model;
 
 // output data : used by fragment shader
 out vec3 fragColor;
 
 void main ()
 {
-    vec4 v = vec4(vertexPosition, 1); // Transform an homogeneous 4D vector
+    // Stretch along x, rotate about the mesh origin, then move into place
+    float c = cos(Model.z);
+    float s = sin(Model.z);
+    vec2 q = vec2(vertexPosition.x * Model.w, vertexPosition.y);
+    vec2 p = vec2(c * q.x - s * q.y,
+                  s * q.x + c * q.y);
+    vec4 v = vec4(p + Model.xy, vertexPosition.z, 1); // Transform an homogeneous 4D vector
 
     // The color of each vertex will be interpolated
     // to produce the color of each fragment
     fragColor = vertexColor;
 
-    // Output position of the vertex, in clip space : MVP * position
-    gl_Position = MVP * v;
+    // Output position of the vertex, in clip space : VP * position
+    gl_Position = VP * v;
 }
@@ -1,12 +1,38 @@
 #include <iostream>
 #include <cmath>
 #include <fstream>
+#include <sstream>
 #include <vector>
+#include <cstring>
+#include <chrono>
+#include <thread>
+#include <atomic>
 
 #include <GL/glew.h>
 #include <GL/glu.h>
 #include <GL/freeglut.h>
 
+#include "entity_store.h"
+#include "spatial_grid.h"
+#include "profiler.h"
+#include "gpu_timer.h"
+#include "shader_cache.h"
+#include "gl_state.h"
+#include "score_display.h"
+#include "replay.h"
+#include "mirror.h"
+#include "level.h"
+#include "simulation.h"
+#include "offscreen.h"
+#include "png_writer.h"
+#include "input_queue.h"
+#include "snapshot.h"
+#include "latency.h"
+#include "camera_ubo.h"
+#include "stream_buffer.h"
+#include "frame_arena.h"
+#include "scene_graph.h"
+
 #define GLM_FORCE_RADIANS
 #include <glm/glm.hpp>
 #include <glm/gtx/transform.hpp>
@@ -14,53 +40,91 @@
 
 using namespace std;
 
-struct VAO {
-    GLuint VertexArrayID;
-    GLuint VertexBuffer;
-    GLuint ColorBuffer;
+/* A shape in the shared mesh buffer - a range of vertices plus how to draw it */
+struct Mesh {
+    GLint First;
+    GLsizei NumVertices;
 
     GLenum PrimitiveMode;
     GLenum FillMode;
-    int NumVertices;
 };
-typedef struct VAO VAO;
+typedef struct Mesh Mesh;
+
+/* All static geometry is baked into one interleaved buffer (x,y,z,r,g,b per
+   vertex) behind one VAO. Shapes are appended while the models are created
+   and uploaded once by uploadMeshes(). */
+const int MAX_MESHES=64;
+struct MeshBuffer {
+    GLuint VertexArrayID;
+    GLuint VertexBuffer;
+    std::vector<GLfloat> staging;
+    Mesh table[MAX_MESHES];
+    int count;
+} meshBuffer;
 
 struct GLMatrices {
 	glm::mat4 projection;
 	glm::mat4 model;
 	glm::mat4 view;
-	GLuint MatrixID;
+	GLuint ModelID;
 } Matrices;
+CameraBuffer camera;
+
+/* Where every shape drawn with Sample_GL.vert sits, with world placements
+   cached between frames - see sceneFrame() */
+SceneGraph scene;
+int nodeHud, nodeLine, nodeBasket1, nodeBasket2, nodeCannonBase, nodeCannonFace, nodeMirrors;
+
+float radians (float degrees)
+{
+	return degrees*M_PI/180.0f;
+}
+
+/* Per-draw placement for Sample_GL.vert, in the "Model" uniform */
+void setModel (const Placement& p)
+{
+	glUniform4f(Matrices.ModelID, p.x, p.y, p.angle, p.scale_x);
+}
 
 GLuint programID;
+ShaderCache shaderCache;
+GLStateCache glState;
+
+/* Read a whole shader file in one go */
+std::string readShaderFile (const char * path)
+{
+	std::ifstream stream(path, std::ios::in | std::ios::binary);
+	if(!stream.is_open())
+		return std::string();
+	std::ostringstream code;
+	code << stream.rdbuf();
+	return code.str();
+}
 
 /* Function to load Shaders - Use it as it is */
 GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path) {
 
-	// Create the shaders
-	GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
-	GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
+	// Read the shader code from the files
+	std::string VertexShaderCode = readShaderFile(vertex_file_path);
+	std::string FragmentShaderCode = readShaderFile(fragment_file_path);
 
-	// Read the Vertex Shader code from the file
-	std::string VertexShaderCode;
-	std::ifstream VertexShaderStream(vertex_file_path, std::ios::in);
-	if(VertexShaderStream.is_open())
+	// Skip compiling if the driver already gave us this program last time
+	bool useCache = shaderCache.supported();
+	std::string cacheFile;
+	if(useCache)
 	{
-		std::string Line = "";
-		while(getline(VertexShaderStream, Line))
-			VertexShaderCode += "\n" + Line;
-		VertexShaderStream.close();
+		cacheFile = shaderCache.path(VertexShaderCode, FragmentShaderCode);
+		GLuint cached = shaderCache.load(cacheFile);
+		if(cached)
+		{
+			printf("Loaded cached program : %s + %s\n", vertex_file_path, fragment_file_path);
+			return cached;
+		}
 	}
 
-	// Read the Fragment Shader code from the file
-	std::string FragmentShaderCode;
-	std::ifstream FragmentShaderStream(fragment_file_path, std::ios::in);
-	if(FragmentShaderStream.is_open()){
-		std::string Line = "";
-		while(getline(FragmentShaderStream, Line))
-			FragmentShaderCode += "\n" + Line;
-		FragmentShaderStream.close();
-	}
+	// Create the shaders
+	GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
+	GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
 
 	GLint Result = GL_FALSE;
 	int InfoLogLength;
@@ -74,7 +138,7 @@ GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path
 	// Check Vertex Shader
 	glGetShaderiv(VertexShaderID, GL_COMPILE_STATUS, &Result);
 	glGetShaderiv(VertexShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-	std::vector<char> VertexShaderErrorMessage(InfoLogLength);
+	std::vector<char> VertexShaderErrorMessage( max(InfoLogLength, int(1)) );
 	glGetShaderInfoLog(VertexShaderID, InfoLogLength, NULL, &VertexShaderErrorMessage[0]);
 	fprintf(stdout, "%s\n", &VertexShaderErrorMessage[0]);
 
@@ -87,7 +151,7 @@ GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path
 	// Check Fragment Shader
 	glGetShaderiv(FragmentShaderID, GL_COMPILE_STATUS, &Result);
 	glGetShaderiv(FragmentShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-	std::vector<char> FragmentShaderErrorMessage(InfoLogLength);
+	std::vector<char> FragmentShaderErrorMessage( max(InfoLogLength, int(1)) );
 	glGetShaderInfoLog(FragmentShaderID, InfoLogLength, NULL, &FragmentShaderErrorMessage[0]);
 	fprintf(stdout, "%s\n", &FragmentShaderErrorMessage[0]);
 
@@ -96,6 +160,8 @@ GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path
 	GLuint ProgramID = glCreateProgram();
 	glAttachShader(ProgramID, VertexShaderID);
 	glAttachShader(ProgramID, FragmentShaderID);
+	if(useCache)
+		glProgramParameteri(ProgramID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 	glLinkProgram(ProgramID);
 
 	// Check the program
@@ -108,128 +174,319 @@ GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path
 	glDeleteShader(VertexShaderID);
 	glDeleteShader(FragmentShaderID);
 
+	if(useCache && Result == GL_TRUE)
+		shaderCache.save(cacheFile, ProgramID);
+
 	return ProgramID;
 }
 
-/* Generate VAO, VBOs and return VAO handle */
-struct VAO* create3DObject (GLenum primitive_mode, int numVertices, const GLfloat* vertex_buffer_data, const GLfloat* color_buffer_data, GLenum fill_mode=GL_FILL)
+/* Append a shape to the shared mesh buffer and return its table entry */
+struct Mesh* create3DObject (GLenum primitive_mode, int numVertices, const GLfloat* vertex_buffer_data, const GLfloat* color_buffer_data, GLenum fill_mode=GL_FILL)
 {
-    struct VAO* vao = new struct VAO;
-    vao->PrimitiveMode = primitive_mode;
-    vao->NumVertices = numVertices;
-    vao->FillMode = fill_mode;
+    if (meshBuffer.count == MAX_MESHES) {
+        cout << "Error: more than " << MAX_MESHES << " meshes" << endl;
+        exit (1);
+    }
+    struct Mesh* mesh = &meshBuffer.table[meshBuffer.count++];
+    mesh->First = meshBuffer.staging.size() / 6;
+    mesh->NumVertices = numVertices;
+    mesh->PrimitiveMode = primitive_mode;
+    mesh->FillMode = fill_mode;
 
-    // Create Vertex Array Object
-    glGenVertexArrays(1, &(vao->VertexArrayID)); // VAO
-    glGenBuffers (1, &(vao->VertexBuffer)); // VBO - vertices
-    glGenBuffers (1, &(vao->ColorBuffer));  // VBO - colors
+    for (int i=0; i<numVertices; i++) {
+        meshBuffer.staging.insert(meshBuffer.staging.end(), vertex_buffer_data + 3*i, vertex_buffer_data + 3*i + 3);
+        meshBuffer.staging.insert(meshBuffer.staging.end(), color_buffer_data + 3*i, color_buffer_data + 3*i + 3);
+    }
+    return mesh;
+}
+
+/* Append a shape to the shared mesh buffer - Common Color for all vertices */
+struct Mesh* create3DObject (GLenum primitive_mode, int numVertices, const GLfloat* vertex_buffer_data, const GLfloat red, const GLfloat green, const GLfloat blue, GLenum fill_mode=GL_FILL)
+{
+    std::vector<GLfloat> color_buffer_data (3*numVertices);
+    for (int i=0; i<numVertices; i++) {
+        color_buffer_data [3*i] = red;
+        color_buffer_data [3*i + 1] = green;
+        color_buffer_data [3*i + 2] = blue;
+    }
 
-    glBindVertexArray (vao->VertexArrayID); // Bind the VAO 
-    glBindBuffer (GL_ARRAY_BUFFER, vao->VertexBuffer); // Bind the VBO vertices 
-    glBufferData (GL_ARRAY_BUFFER, 3*numVertices*sizeof(GLfloat), vertex_buffer_data, GL_STATIC_DRAW); // Copy the vertices into VBO
+    return create3DObject(primitive_mode, numVertices, vertex_buffer_data, &color_buffer_data[0], fill_mode);
+}
+
+/* Upload every created shape in one go and set up the shared VAO */
+void uploadMeshes ()
+{
+    glGenVertexArrays(1, &(meshBuffer.VertexArrayID)); // VAO
+    glGenBuffers (1, &(meshBuffer.VertexBuffer)); // VBO - interleaved vertices and colors
+
+    glState.bindVertexArray (meshBuffer.VertexArrayID); // Bind the VAO
+    glState.bindArrayBuffer (meshBuffer.VertexBuffer); // Bind the VBO
+    glBufferData (GL_ARRAY_BUFFER, meshBuffer.staging.size()*sizeof(GLfloat), &meshBuffer.staging[0], GL_STATIC_DRAW);
     glVertexAttribPointer(
                           0,                  // attribute 0. Vertices
                           3,                  // size (x,y,z)
                           GL_FLOAT,           // type
                           GL_FALSE,           // normalized?
-                          0,                  // stride
+                          6*sizeof(GLfloat),  // stride
                           (void*)0            // array buffer offset
                           );
-
-    glBindBuffer (GL_ARRAY_BUFFER, vao->ColorBuffer); // Bind the VBO colors 
-    glBufferData (GL_ARRAY_BUFFER, 3*numVertices*sizeof(GLfloat), color_buffer_data, GL_STATIC_DRAW);  // Copy the vertex colors
     glVertexAttribPointer(
                           1,                  // attribute 1. Color
                           3,                  // size (r,g,b)
                           GL_FLOAT,           // type
                           GL_FALSE,           // normalized?
-                          0,                  // stride
-                          (void*)0            // array buffer offset
+                          6*sizeof(GLfloat),  // stride
+                          (void*)(3*sizeof(GLfloat)) // array buffer offset
                           );
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
 
-    return vao;
+    // the GL copy is all we need from here on
+    std::vector<GLfloat>().swap(meshBuffer.staging);
 }
 
-/* Generate VAO, VBOs and return VAO handle - Common Color for all vertices */
-struct VAO* create3DObject (GLenum primitive_mode, int numVertices, const GLfloat* vertex_buffer_data, const GLfloat red, const GLfloat green, const GLfloat blue, GLenum fill_mode=GL_FILL)
+/* Render one shape from the shared mesh buffer - its VAO must be bound */
+void draw3DObject (struct Mesh* mesh)
 {
-    GLfloat* color_buffer_data = new GLfloat [3*numVertices];
-    for (int i=0; i<numVertices; i++) {
-        color_buffer_data [3*i] = red;
-        color_buffer_data [3*i + 1] = green;
-        color_buffer_data [3*i + 2] = blue;
-    }
+    // Change the Fill Mode for this object
+    glState.polygonMode (mesh->FillMode);
 
-    return create3DObject(primitive_mode, numVertices, vertex_buffer_data, color_buffer_data, fill_mode);
+    // Draw the geometry !
+    glDrawArrays(mesh->PrimitiveMode, mesh->First, mesh->NumVertices);
 }
 
-/* Render the VBOs handled by VAO */
-void draw3DObject (struct VAO* vao)
+/* Draw a mesh at a scene node's cached world placement */
+void drawNode (int node, struct Mesh* mesh)
 {
-    // Change the Fill Mode for this object
-    glPolygonMode (GL_FRONT_AND_BACK, vao->FillMode);
+	setModel(scene.world[node]);
+	draw3DObject(mesh);
+}
 
-    // Bind the VAO to use
-    glBindVertexArray (vao->VertexArrayID);
+/* Dynamic per-frame data (instances) is written straight into one streaming buffer */
+StreamBuffer streamBuffer;
 
-    // Enable Vertex Attribute 0 - 3d Vertices
+/* Instanced drawing - one shared mesh, per-instance transform and color.
+   Instances are written into the stream buffer as they are produced and
+   submitted with a single call. */
+struct InstanceBatch {
+    GLuint VertexArrayID;
+    GLint First;
+    GLsizei NumVertices;
+    GLfloat* write;     // this frame's instances, x, y, rotation (radians), r, g, b each
+    GLintptr offset;    // where they are in the stream buffer
+    int capacity, count;
+};
+GLuint instancedProgramID;
+
+/* Generate a VAO that reads vertices from 'mesh'; transforms come from the stream buffer */
+struct InstanceBatch* createInstanceBatch (struct Mesh* mesh)
+{
+    struct InstanceBatch* batch = new struct InstanceBatch;
+    batch->First = mesh->First;
+    batch->NumVertices = mesh->NumVertices;
+    batch->write = NULL;
+    batch->capacity = batch->count = 0;
+
+    glGenVertexArrays(1, &(batch->VertexArrayID));
+
+    glState.bindVertexArray (batch->VertexArrayID);
+    glState.bindArrayBuffer (meshBuffer.VertexBuffer); // Shared mesh vertices
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6*sizeof(GLfloat), (void*)0);
     glEnableVertexAttribArray(0);
-    // Bind the VBO to use
-    glBindBuffer(GL_ARRAY_BUFFER, vao->VertexBuffer);
 
-    // Enable Vertex Attribute 1 - Color
-    glEnableVertexAttribArray(1);
-    // Bind the VBO to use
-    glBindBuffer(GL_ARRAY_BUFFER, vao->ColorBuffer);
+    // Per instance data - pointed at this frame's range when drawn
+    glEnableVertexAttribArray(2);
+    glEnableVertexAttribArray(3);
+    glVertexAttribDivisor(2, 1); // advance once per instance
+    glVertexAttribDivisor(3, 1);
 
-    // Draw the geometry !
-    glDrawArrays(vao->PrimitiveMode, 0, vao->NumVertices); // Starting from vertex 0; 3 vertices total -> 1 triangle
+    return batch;
+}
+
+/* Make room for up to 'instances' this frame */
+void beginInstanceBatch (struct InstanceBatch* batch, int instances)
+{
+    batch->count = 0;
+    batch->capacity = instances;
+    batch->write = instances ? (GLfloat*) streamBuffer.map(instances*6*sizeof(GLfloat), batch->offset) : NULL;
+}
+
+void addInstance (struct InstanceBatch* batch, float x, float y, float rotation, float red, float green, float blue)
+{
+    if (batch->count == batch->capacity)
+        return;
+    GLfloat* instance = batch->write + 6*batch->count++;
+    instance[0] = x;
+    instance[1] = y;
+    instance[2] = rotation;
+    instance[3] = red;
+    instance[4] = green;
+    instance[5] = blue;
+}
+
+/* Draw the instances written since beginInstanceBatch() in one call */
+void drawInstanceBatch (struct InstanceBatch* batch)
+{
+    streamBuffer.unmap();
+    int instances = batch->count;
+    batch->count = batch->capacity = 0;
+    if (instances == 0)
+        return;
+    glState.bindVertexArray (batch->VertexArrayID);
+    glState.bindArrayBuffer (streamBuffer.buffer);
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 6*sizeof(GLfloat), (void*)batch->offset);
+    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 6*sizeof(GLfloat), (void*)(batch->offset + 3*sizeof(GLfloat)));
+    glState.polygonMode (GL_FILL);
+    glDrawArraysInstanced(GL_TRIANGLES, batch->First, batch->NumVertices, instances);
 }
 
 /**************************
  * Customizable functions *
  **************************/
-struct VAO* Basket1;
-struct VAO* CannonBase;
-struct VAO* Basket2;
-struct VAO* CannonFace;
+struct Mesh* Basket1;
+struct Mesh* CannonBase;
+struct Mesh* Basket2;
+struct Mesh* CannonFace;
 float triangle_rot_dir = 1;
 float rectangle_rot_dir = 1;
 bool triangle_rot_status = true;
 bool rectangle_rot_status = true;
 float temp=0;
-int s1=0,s2=0,s3=0,s4=0,s5=0,s6=0,f1=0,f2=0,f3=0,f4=0,f21=0,f22=0,f23=0,f24=0,neg=0;
-long long int FLAG_GOLI[1000],flagblack[1000],FLAG_GRN[1000],flagred[1000],FLAG_GOLIMIRR1[1000],FLAG_GOLIMIRR2[1000],FLAG_GOLIMIRR3[1000],FLAG_GOLIMIRR4[1000];
 int score=0;
-float change=0,current_time,REDCHANGE[1000]={4.5},GREENCHANGE[1000]={4.5},BLACKCHANGE[1000]={4.5},YBULLET[1000],CANNONY[1000],ROTATEBULLET[1000];
+float change=0,current_time;
+
+BrickStore bricks;
+BulletStore bullets;
+BulletIntegrator integrator;
+
+/* Board layout - mirrors, basket widths and spawn odds, from --level or the built-in board */
+Level level;
+const char* level_path=NULL;
+long long level_stamp=0;
+
+/* Brick spawning draws from this, seeded once per session (--seed) */
+Rng gameRng;
+uint64_t game_seed=time(NULL);
+
 void initialise()
 {
-        int i;
-        srand(time(NULL));
-        for(i=0;i<1000;i++)
-        {
-                REDCHANGE[i]=4.5;
-               // xred[i]=(float)(((rand())%680-280)/100.0);
-               // xgreen[i]=(float)(((rand())%680-280)/100.0);
-               // xblack[i]=(float)(((rand())%680-280)/100.0);
-                BLACKCHANGE[i]=4.5;
-                GREENCHANGE[i]=4.5;
-               // bulletx[i]=0;
-                YBULLET[i]=0;
-                CANNONY[i]=0;
-                ROTATEBULLET[i]=0;
-                FLAG_GOLI[i]=0;
-                flagblack[i]=0;
-                FLAG_GRN[i]=0;
-                flagred[i]=0;
-                FLAG_GOLIMIRR1[i]=0;
-                FLAG_GOLIMIRR2[i]=0;
-                FLAG_GOLIMIRR3[i]=0;
-                FLAG_GOLIMIRR4[i]=0;
+        bricks.clear();
+        bullets.clear();
+}
 
-        }
+/* Game clock in milliseconds - GLUT elapsed time normally, a virtual clock in headless mode,
+   the steady clock when the simulation has its own thread (GLUT is not to be called from it) */
+long long virtual_time=0;
+long long glutClock ()
+{
+	return glutGet(GLUT_ELAPSED_TIME);
+}
+long long steadyClock ()
+{
+	return steadyMicros()/1000;
+}
+long long virtualClock ()
+{
+	return virtual_time;
+}
+long long (*gameClock)() = glutClock;
+
+/* Fixed timestep - the simulation always advances in steps of 1/sim_hz seconds,
+   however often frames are drawn. Rendering interpolates by render_alpha. */
+int sim_hz=60;
+double sim_time=0;            // simulated milliseconds
+long long sim_ticks=0;
+double sim_accumulator=0;     // wall milliseconds not yet simulated
+long long sim_last_clock=0;
+float render_alpha=1;
+const int MAX_STEPS_PER_FRAME=5;
+const float BULLET_SPEED=6;   // units per second
+
+/* Per-phase CPU timings - enabled with --profile or --trace */
+Profiler profiler;
+const char* trace_path=NULL;
+/* Per-pass GPU timings - enabled with --gpu-timing */
+GpuTimer gpuTimer;
+/* Input-to-photon latency - enabled with --latency */
+LatencyTracker latency;
+/* Scratch memory for the render thread's per-frame temporaries, reset
+   every frame - so far just the sort buffer behind the percentiles in the
+   window title and the latency overlay. The simulation thread allocates
+   nothing per tick and has no arena. --arena-stats reports how much each
+   frame needed */
+FrameArena renderArena("render", 256*1024);
+bool arena_stats=false;
+
+/* Print the percentiles and write the trace however the game ends */
+void profilerExit ()
+{
+	/* first, while the arena holds only what the frames needed */
+	if(arena_stats)
+		renderArena.report(stdout);
+	if(gpuTimer.enabled)
+		gpuTimer.report(stdout);
+	if(latency.enabled)
+		latency.report(stdout);
+	if(!profiler.enabled)
+		return;
+	profiler.report(stdout);
+	if(glState.frames)
+	{
+		glState.report(stdout);
+		streamBuffer.report(stdout);
+		printf("scene: %zu nodes, %.2f world placements recomputed per frame\n", scene.size(),
+			scene.passes ? (double) scene.recomputed/scene.passes : 0.0);
+	}
+	if(trace_path)
+	{
+		if(profiler.writeTrace(trace_path))
+			cout << "profiler: trace written to " << trace_path << "\n";
+		else
+			cout << "profiler: could not write " << trace_path << "\n";
+	}
+}
+
+/* Headless mode state - no window, no GL context */
+bool headless=false;
+/* Offscreen mode - headless, but draw() renders into an EGL framebuffer */
+bool offscreen=false;
+const char* frame_dir=NULL;
+int frame_every=60;
+long long games_played=0;
+void resetGame ();
+/* Windowed mode runs the simulation on its own thread unless --single-thread */
+bool sim_threaded=false;
+
+/* Called from inside a tick; the game actually ends once the tick completes */
+const char* game_over=NULL;
+void gameOver (const char* message)
+{
+	game_over=message;
+}
 
+/* End of a game: windowed mode prints and quits, headless mode starts the next game.
+   A simulation thread leaves game_over set and stops; the render thread sees it in
+   the last snapshot and does the printing and quitting. */
+void endGame ()
+{
+	if(sim_threaded)
+		return;
+	if(!headless)
+	{
+		cout << score <<"\n";
+		cout << game_over << "\n";
+		exit(0);
+	}
+	games_played++;
+	game_over=NULL;
+	resetGame();
 }
+
+/* Session journal - --record writes every input with the tick it lands on,
+   and a fingerprint of the game state that --replay checks against */
+Journal journal;
+bool hashing=false;
+uint64_t state_hash=14695981039346656037ULL;
 /* Executed when a regular key is pressed */
 void keyboardDown (unsigned char key, int x, int y)
 {
@@ -247,11 +504,24 @@ float movcannon=0;
 float rotatecannon=0;
 float speed=1;
 float dist=0.1;
-long long count=0;int Ctrl=0,Alt=0;
-long long int cur;
-	long long int l=0;
+int Ctrl=0,Alt=0;
+double cur;
+double l=0;
+long long bullets_fired=0;
+/* Fire a bullet from the cannon - atleast 1 second of game time between 2 consecutive bullets */
+void fireBullet ()
+{
+	cur = sim_time;
+	if ((cur - l) >= 1000 && bullets.add(MUZZLE_X, movcannon, rotatecannon).valid())
+	{
+		Ctrl=0;
+		Alt=0;
+		bullets_fired++;
+		l=cur;
+	}
+}
 /* Executed when a regular key is released */
-void keyboardUp (unsigned char key, int x, int y)
+void applyKeyUp (unsigned char key, int x, int y)
 {
     switch (key) {
 	case 'n':
@@ -282,23 +552,12 @@ void keyboardUp (unsigned char key, int x, int y)
 		break;
         
         case 'x':
-		count++;
+		bullets.add(MUZZLE_X, 0, 0);
             // do something
             break;
 	case 32:
-	
-	cur = glutGet(GLUT_ELAPSED_TIME); 
-        if ((cur - l) >= 1000)
-	{
-                        Ctrl=0;
-                        Alt=0;
-                       // count++;
-                        CANNONY[count]=movcannon;
-                        ROTATEBULLET[count]=rotatecannon;
-			count++;
-			l=cur;
-   	}
-                     break;
+		fireBullet();
+		break;
 
         default:
             break;
@@ -310,7 +569,7 @@ void keyboardUp (unsigned char key, int x, int y)
 float mov1=0;
 float mov2=0,xchang=0,ychang=0,zoom=1;
 /* Executed when a special key is pressed */
-void keyboardSpecialDown (int key, int x, int y)
+void applySpecialDown (int key, int x, int y)
 {
 	switch (key) {
               
@@ -396,7 +655,7 @@ void keyboardSpecialUp (int key, int x, int y)
  at screen position ('x', 'y')
  */
 int mouse_clicked=0;
-void mouseClick (int button, int state, int x, int y)
+void applyMouseButton (int button, int state, int x, int y)
 {
     switch (button) {
                 case GLUT_LEFT_BUTTON:
@@ -405,17 +664,8 @@ void mouseClick (int button, int state, int x, int y)
 
         case GLUT_RIGHT_BUTTON:
                         if (state == GLUT_DOWN)
-                        {cur = glutGet(GLUT_ELAPSED_TIME); 
-        if ((cur - l) >= 1000)
-	{
-                        Ctrl=0;
-                        Alt=0;
-                       // count++;
-                        CANNONY[count]=movcannon;
-                        ROTATEBULLET[count]=rotatecannon;
-			count++;
-			l=cur;
-   	}
+                        {
+		fireBullet();
 		mouse_clicked=1;
 			
                         }
@@ -428,16 +678,16 @@ void mouseClick (int button, int state, int x, int y)
 }
 
 /* Executed when the mouse moves to position ('x', 'y') */
-void mouseMotion (int x, int y)
+void applyMouseMotion (int x, int y)
 {
 	//cout  << "chal raha \n";
 	int x1,y1;
 	x1=x-400;y1=400-y;
 	int redx1,redx2,greenx1,greenx2;
-	redx1=(-0.5+mov1 -2)*100;
+	redx1=(-0.5+mov1 -level.basket_width[0])*100;
 	redx2=(-0.5+mov1)*100;
 	greenx1=(0.5+mov2)*100;
-	greenx2=(0.5+mov2 + 2 )*100;
+	greenx2=(0.5+mov2 + level.basket_width[1] )*100;
 	if(y>=600)
 	{
 		if((redx1 <= x1) && (redx2 >= x1))
@@ -467,6 +717,79 @@ void mouseMotion (int x, int y)
 	
 }
 
+/* Apply one input to the game - the same path for live, recorded and replayed input */
+void applyInput (const InputEvent& e)
+{
+	switch(e.type)
+	{
+	case INPUT_KEY_UP:
+		applyKeyUp(e.code, e.x, e.y);
+		break;
+	case INPUT_SPECIAL_DOWN:
+		applySpecialDown(e.code, e.x, e.y);
+		break;
+	case INPUT_MOUSE_BUTTON:
+		applyMouseButton(e.code, e.state, e.x, e.y);
+		break;
+	case INPUT_MOUSE_MOTION:
+		applyMouseMotion(e.x, e.y);
+		break;
+	case INPUT_AIM:
+		rotatecannon=e.x;
+		break;
+	default:
+		break;
+	}
+}
+
+/* Inputs from the window callbacks, waiting for the start of the next tick.
+   The callbacks only ever push and the simulation only ever pops, so
+   the two can run on different threads. */
+SpscRing<QueuedInput, 1024> inputQueue;
+long long inputs_dropped=0;
+
+/* Queue an input for the simulation; callbacks touch no game state */
+void submitInput (int type, int code, int state, int x, int y)
+{
+	QueuedInput q = { { 0, (uint8_t) type, (uint8_t) code, (uint8_t) state, (int16_t) x, (int16_t) y }, steadyMicros() };
+	if(!inputQueue.push(q) && inputs_dropped++==0)
+		cout << "input: queue full, dropping events\n";
+}
+
+/* Start of a tick - stamp every queued input with this tick, journal it and apply it */
+void drainInput ()
+{
+	ProfileScope scope(profiler, PHASE_INPUT);
+	QueuedInput q;
+	while(inputQueue.pop(q))
+	{
+		q.event.tick=(uint32_t) sim_ticks;
+		journal.write(q.event);
+		long long fired=bullets_fired;
+		applyInput(q.event);
+		if(latency.enabled)
+			latency.applied(sim_ticks, q.stamp_us, bullets_fired!=fired ? LATENCY_FIRE : LATENCY_OTHER);
+	}
+}
+
+/* GLUT input callbacks */
+void keyboardUp (unsigned char key, int x, int y)
+{
+	submitInput(INPUT_KEY_UP, key, 0, x, y);
+}
+void keyboardSpecialDown (int key, int x, int y)
+{
+	submitInput(INPUT_SPECIAL_DOWN, key, 0, x, y);
+}
+void mouseClick (int button, int state, int x, int y)
+{
+	submitInput(INPUT_MOUSE_BUTTON, button, state, x, y);
+}
+void mouseMotion (int x, int y)
+{
+	submitInput(INPUT_MOUSE_MOTION, 0, 0, x, y);
+}
+
 /* Executed when window is resized to 'width' and 'height' */
 /* Modify the bounds of the screen here in glm::ortho or Field of View in glm::Perspective */
 void reshapeWindow (int width, int height)
@@ -486,7 +809,7 @@ void reshapeWindow (int width, int height)
     Matrices.projection = glm::ortho(-4.0f, 4.0f, -4.0f, 4.0f, 0.1f, 500.0f);
 }
 
-VAO *triangle, *rectangle;
+Mesh *triangle, *rectangle;
 
 // Creates the triangle object used in this sample code
 void createTriangle ()
@@ -506,7 +829,7 @@ void createTriangle ()
     0,0,1, // color 2
   };
 
-  // create3DObject creates and returns a handle to a VAO that can be used later
+  // create3DObject adds the shape to the shared mesh buffer and returns its table entry
   triangle = create3DObject(GL_TRIANGLES, 3, vertex_buffer_data, color_buffer_data, GL_LINE);
 }
 
@@ -533,7 +856,7 @@ void createRectangle ()
     1,0,0  // color 1
   };
 
-  // create3DObject creates and returns a handle to a VAO that can be used later
+  // create3DObject adds the shape to the shared mesh buffer and returns its table entry
   rectangle = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
 }
 void createBasket1 ()
@@ -559,7 +882,7 @@ void createBasket1 ()
     0,1,0  // color 1
   };
 
-  // create3DObject creates and returns a handle to a VAO that can be used later
+  // create3DObject adds the shape to the shared mesh buffer and returns its table entry
   Basket1 = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
 }
 void createBasket2 ()
@@ -585,7 +908,7 @@ void createBasket2 ()
     1,0,0  // color 1
   };
 
-  // create3DObject creates and returns a handle to a VAO that can be used later
+  // create3DObject adds the shape to the shared mesh buffer and returns its table entry
   Basket2 = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
 }
 void createCannonBase ()
@@ -611,7 +934,7 @@ void createCannonBase ()
     0,0,0  // color 1
   };
 
-  // create3DObject creates and returns a handle to a VAO that can be used later
+  // create3DObject adds the shape to the shared mesh buffer and returns its table entry
   CannonBase = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
 }
 
@@ -638,10 +961,10 @@ void createCannonFace ()
     0,0,0  // color 1
   };
 
-  // create3DObject creates and returns a handle to a VAO that can be used later
+  // create3DObject adds the shape to the shared mesh buffer and returns its table entry
   CannonFace = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
 }
-struct VAO* Line;
+struct Mesh* Line;
 void createLine()
 {
 // GL3 accepts only Triangles. Quads are not supported static
@@ -665,74 +988,18 @@ void createLine()
     0,0,0  // color 1
   };
 
-  // create3DObject creates and returns a handle to a VAO that can be used later
+  // create3DObject adds the shape to the shared mesh buffer and returns its table entry
   Line = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
 
 }
-struct VAO* seedha;
-void createseedha()
-{
-// GL3 accepts only Triangles. Quads are not supported static
-  const GLfloat vertex_buffer_data [] = {
-    0,0,0, // vertex 1
-    0.3,0,0, // vertex 2
-    0.3, 0.1,0, // vertex 3
-
-   0.3, 0.1,0, // vertex 3
-    0, 0.1,0, // vertex 4
-    0,0,0//i,0  // vertex 1
-  };
-
-  static const GLfloat color_buffer_data [] = {
-    0,0,0, // color 1
-    0,0,0, // color 2
-    0,0,0, // color 3
-
-    0,0,0, // color 3
-    0,0,0, // color 4
-    0,0,0  // color 1
-  };
-
-  // create3DObject creates and returns a handle to a VAO that can be used later
-  seedha = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
-
-}
-struct VAO* tedha;
-void createtedha()
-{
-// GL3 accepts only Triangles. Quads are not supported static
-  const GLfloat vertex_buffer_data [] = {
-    0,0,0, // vertex 1
-    0.05,0,0, // vertex 2
-    0.05, 0.3,0, // vertex 3
-
-   0.05, 0.3,0, // vertex 3
-    0, 0.3,0, // vertex 4
-    0,0,0//i,0  // vertex 1
-  };
-
-  static const GLfloat color_buffer_data [] = {
-    0,0,0, // color 1
-    0,0,0, // color 2
-    0,0,0, // color 3
-
-    0,0,0, // color 3
-    0,0,0, // color 4
-    0,0,0  // color 1
-  };
-
-  // create3DObject creates and returns a handle to a VAO that can be used later
-  tedha = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
-
-}
-struct VAO* Red;
-struct VAO* Black;
-struct VAO* Green;
-struct VAO* Bullet;
-struct VAO* MIRR1;
-struct VAO* MIRR2;
-struct VAO* MIRR3;
-struct VAO* Board;
+struct Mesh* Red;
+struct Mesh* Bullet;
+struct InstanceBatch* BrickBatch;
+ScoreDisplay scoreDisplay(3.55, 3.15); // units digit top right, more digits grow leftwards
+ScoreDisplay latencyDisplay(-3.0, 3.15); // --latency overlay, top left
+struct InstanceBatch* BulletBatch;
+struct Mesh* MirrorMesh;
+struct Mesh* Board;
 void createRed ()
 {
   // GL3 accepts only Triangles. Quads are not supported static
@@ -756,61 +1023,9 @@ void createRed ()
     1,0,0  // color 1
   };
 
-  // create3DObject creates and returns a handle to a VAO that can be used later
+  // create3DObject adds the shape to the shared mesh buffer and returns its table entry
   Red = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
 }
-void createBlack ()
-{
-  // GL3 accepts only Triangles. Quads are not supported static
-  const GLfloat vertex_buffer_data [] = {
-    0,0,0, // vertex 1
-    0.2,0,0, // vertex 2
-    0.2,0.3,0, // vertex 3
-
-   0.2,0.3,0, // vertex 3
-    0,0.3,0, // vertex 4
-    0,0,0  // vertex 1
-  };
-
-  static const GLfloat color_buffer_data [] = {
-    0,0,0, // color 1
-    0,0,0, // color 2
-    0,0,0, // color 3
-
-    0,0,0, // color 3
-    0,0,0, // color 4
-    0,0,0  // color 1
-  };
-
-  // create3DObject creates and returns a handle to a VAO that can be used later
-  Black = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
-}
-void createGreen ()
-{
-  // GL3 accepts only Triangles. Quads are not supported static
-  const GLfloat vertex_buffer_data [] = {
-    0,0,0, // vertex 1
-    0.2,0,0, // vertex 2
-    0.2, 0.3,0, // vertex 3
-
-   0.2, 0.3,0, // vertex 3
-    0, 0.3,0, // vertex 4
-    0,0,0  // vertex 1
-  };
-
-  static const GLfloat color_buffer_data [] = {
-    0,1,0, // color 1
-    0,1,0, // color 2
-    0,1,0, // color 3
-
-    0,1,0, // color 3
-    0,1,0, // color 4
-    0,1,0  // color 1
-  };
-
-  // create3DObject creates and returns a handle to a VAO that can be used later
-  Green = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
-}
 void createBullet ()
 {
   // GL3 accepts only Triangles. Quads are not supported static
@@ -834,7 +1049,7 @@ void createBullet ()
     0,0,1  // color 1
   };
 
-  // create3DObject creates and returns a handle to a VAO that can be used later
+  // create3DObject adds the shape to the shared mesh buffer and returns its table entry
   Bullet = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
 }
 void createBoard ()
@@ -860,10 +1075,10 @@ void createBoard ()
     0,0,1  // color 1
   };
 
-  // create3DObject creates and returns a handle to a VAO that can be used later
+  // create3DObject adds the shape to the shared mesh buffer and returns its table entry
   Board = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
 }
-void createMIRR1 ()
+void createMirror ()
 {
         // GL3 accepts only Triangles. Quads are not supported static
         const GLfloat vertex_buffer_data [] = {
@@ -887,660 +1102,446 @@ void createMIRR1 ()
         
         };
         
-        // create3DObject creates and returns a handle to a VAO that can be used later
-        MIRR1 = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
-}
-void createMIRR2 ()
-{
-        // GL3 accepts only Triangles. Quads are not supported static
-        const GLfloat vertex_buffer_data [] = {
-                -0.4,0.025,0, // vertex 1
-                -0.4,-0.025,0, // vertex 2
-                0.4, -0.025,0, // vertex 3
-
-                0.4, -0.025,0, // vertex 3
-                0.4, 0.025,0, // vertex 4
-                -0.4,0.025,0,  // vertex 1
-        };
-
-        static const GLfloat color_buffer_data [] = {
-                0.52f,0.8f,0.98f, // color 1
-                0.52f,0.8f,0.98f, // color 1
-                0.52f,0.8f,0.98f, // color 1
-
-                0.52f,0.8f,0.98f, // color 1
-                0.52f,0.8f,0.98f, // color 1
-                0.52f,0.8f,0.98f, // color 1
-
-        };
-
-        // create3DObject creates and returns a handle to a VAO that can be used later
-        MIRR2 = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
-}
-void createMIRR3 ()
-{
-        // GL3 accepts only Triangles. Quads are not supported static
-        const GLfloat vertex_buffer_data [] = {
-                -0.4,0.025,0, // vertex 1
-                -0.4,-0.025,0, // vertex 2
-                0.4, -0.025,0, // vertex 3
-
-                0.4, -0.025,0, // vertex 3
-                0.4, 0.025,0, // vertex 4
-                -0.4,0.025,0,  // vertex 1
-        };
-
-        static const GLfloat color_buffer_data [] = {
-                0.52f,0.8f,0.98f, // color 1
-                0.52f,0.8f,0.98f, // color 1
-                0.52f,0.8f,0.98f, // color 1
-
-                0.52f,0.8f,0.98f, // color 1
-                0.52f,0.8f,0.98f, // color 1
-                0.52f,0.8f,0.98f, // color 1
-
-        };
-
-        // create3DObject creates and returns a handle to a VAO that can be used later
-        MIRR3 = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
+        // create3DObject adds the shape to the shared mesh buffer and returns its table entry
+        MirrorMesh = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
 }
 
 float camera_rotation_angle = 90;
 float rectangle_rotation = 0;
 float triangle_rotation = 0;
-long long int last_update_time=0;
-long long int countred=0;
-float red[1000]={4};
-float redy[1000]={4};
-long long int countblack=0;
-float black[1000]={4};
-float blacky[1000]={4};
-long long int countgreen=0;
-float green[1000]={4};
-float greeny[1000]={4};
-float bulletx[1000]={0};
-long long int countbullet=0;
+double last_update_time=0;
 void declare()
 {
-	long long int current_time;
-	current_time = glutGet(GLUT_ELAPSED_TIME); // Time in seconds
+	double current_time;
+	current_time = sim_time; // Time in milliseconds
         if ((current_time - last_update_time) >= 1000/speed) { // atleast 1000 milisecond s elapsed since last frame
-            for(int j=0;j<countred;j++)
-            {
-                    redy[j]=redy[j]-0.3*speed;
-                   // cout << redy[j] << endl;
-
-            }
-            for(int j=0;j<countblack;j++)
-            {
-                    blacky[j]=blacky[j]-0.3*speed;
-                   // cout << redy[j] << endl;
-
-            }
-            for(int j=0;j<countgreen;j++)
-            {
-                    greeny[j]=greeny[j]-0.3*speed;
-                   // cout << redy[j] << endl;
-
-            }
-            int value=rand()%5;
-	    int position=rand()%6-3;
-	    //if(position<-3)
-            //position++;
-            //else if (position>4)
-   	    //position--;
-            if(value==0)
-            {
-                    countred++;        
-                    red[countred-1]=position;
-                    redy[countred-1]=4;
-            }
-	else if(value==2)
-            {
-                    countblack++;
-          //          int position=rand()%8-4;
-                    black[countblack-1]=position;
-                    blacky[countblack-1]=4;
-            }
-            else if(value==4)
-            {
-                    countgreen++;
-            //        int position=rand()%8-4;
-                    green[countgreen-1]=position;
-                    greeny[countgreen-1]=4;
-            }
+            for(size_t j=0;j<bricks.size();j++)
+                    bricks.setY(j, bricks.y[j]-0.3*speed);
+            spawnBrick(bricks, level, gameRng);
             last_update_time = current_time;
         }
-	/*long long time=0;
-		current_time = glutGet(GLUT_ELAPSED_TIME); // Time in seconds
-	if(current_time - time >100)
-	{	countbullet++;
-	bulletx[countbullet-1]+=0.05;
-	}*/
- 
+}
+
+/* Clear all bricks, bullets and the score for a fresh game */
+void resetGame ()
+{
+	initialise();
+	score=0;
+	last_update_time=sim_time;
+}
+
+/* Baskets and bullet hits - scoring lives here, not in draw() */
+void collide ()
+{
+	size_t i;
+	float w1=level.basket_width[0],w2=level.basket_width[1];
+	// bricks that reached the line are caught by a basket or end the game
+	for(i=0;i<bricks.size();)
+	{
+		float bx=bricks.x[i],by=bricks.y[i];
+		if(by>(-3))
+		{
+			i++;
+			continue;
+		}
+		if(bricks.type[i]==BRICK_BLACK)
+		{
+			if((bx<=(-0.5+mov1) || (bx +0.2)>=(-0.5-w1+mov1)) || (bx<=(0.5+w2+mov2) || (bx +0.2)>=(0.5+mov2)))
+			{
+				gameOver("GAME OVER");
+				return;
+			}
+		}
+		else if(bricks.type[i]==BRICK_RED)
+		{
+			if(bx<=(0.5+w2+mov2) || (bx +0.2)>=(0.5+mov2))
+				score+=1;
+		}
+		else if(bx<=(-0.5+mov1) || (bx +0.2)>=(-0.5-w1+mov1))
+			score+=1;
+		bricks.remove(i);
+	}
+
+	score+=shootBricks(bullets, bricks);
 }
 
 /* Render the scene with openGL */
 /* Edit this function according to your assignment */
-void draw ()
+/* The fixed part of the scene; everything that moves is placed by sceneFrame() */
+void buildScene ()
 {
+	nodeHud = scene.add(SceneGraph::ROOT, placement(0, 0));     // score and overlays
+	nodeLine = scene.add(SceneGraph::ROOT, placement(0, -3));
+	nodeBasket1 = scene.add(SceneGraph::ROOT, placement(-0.5, -4));
+	nodeBasket2 = scene.add(SceneGraph::ROOT, placement(0.5, -4));
+	nodeCannonBase = scene.add(SceneGraph::ROOT, placement(-4, 0));
+	nodeCannonFace = scene.add(nodeCannonBase, placement(0.25, 0)); // rides on the base
+	nodeMirrors = scene.size();                                      // one per mirror, from here on
+}
+
+/* Move the nodes that follow the game to this snapshot and bring the
+   world placements up to date; nodes that did not move are not touched */
+void sceneFrame (const Snapshot& s)
+{
+	// the basket meshes are 2 wide; stretch them to the level's width about their inner edge
+	float widen1=s.basket_width[0]/2, widen2=s.basket_width[1]/2;
+	scene.setLocal(nodeBasket1, placement(-1+0.5*widen1+s.mov1, -4, 0, widen1));
+	scene.setLocal(nodeBasket2, placement(1-0.5*widen2+s.mov2, -4, 0, widen2));
+	scene.setLocal(nodeCannonBase, placement(-4, 0+s.movcannon));
+	scene.setLocal(nodeCannonFace, placement(0.25, 0, radians(s.rotatecannon)));
+	// a level reload can change the number of mirrors
+	if(scene.size()!=nodeMirrors+s.mirrors.size())
+	{
+		scene.truncate(nodeMirrors);
+		for(size_t m=0;m<s.mirrors.size();m++)
+			scene.add(SceneGraph::ROOT, placement(0, 0));
+	}
+	/* MirrorMesh is 0.8 long; stretch it to the half-length the sweep uses */
+	for(size_t m=0;m<s.mirrors.size();m++)
+		scene.setLocal(nodeMirrors+m, placement(s.mirrors[m].x, s.mirrors[m].y, radians(s.mirrors[m].angle),
+			s.mirrors[m].half/0.4f));
+	scene.update();
+}
+
+/* Draw one frame of a snapshot, bullets 'alpha' of the way from their
+   previous tick to the snapshot's one */
+void draw (const Snapshot& s, float alpha)
+{
+  ProfileScope scope(profiler, PHASE_RENDER);
+  gpuTimer.beginFrame();
   // clear the color and depth in the frame buffer
   glClear (GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
   // use the loaded shader program
   // Don't change unless you know what you are doing
-  glUseProgram (programID);
-
-  // Eye - Location of camera. Don't change unless you are sure!!
-  glm::vec3 eye ( 5*cos(camera_rotation_angle*M_PI/180.0f), 0, 5*sin(camera_rotation_angle*M_PI/180.0f) );
-  // Target - Where is the camera looking at.  Don't change unless you are sure!!
-  glm::vec3 target (0, 0, 0);
-  // Up - Up vector defines tilt of camera.  Don't change unless you are sure!!
-  glm::vec3 up (0, 1, 0);
-
+  glState.beginFrame();
+  streamBuffer.beginFrame();
+  glState.useProgram (programID);
+  glState.bindVertexArray (meshBuffer.VertexArrayID); // every static shape lives here
+
+  // The camera only moves when zoom or pan change; the view-projection then
+  // goes to the Camera uniform buffer that both programs read
+  if(camera.changed(s.zoom, s.xchang, s.ychang))
+  {
   // Compute Camera matrix (view)
-  // Matrices.view = glm::lookAt( eye, target, up ); // Rotating Camera for 3D
   //  Don't change unless you are sure!!
   Matrices.view = glm::lookAt(glm::vec3(0,0,3), glm::vec3(0,0,0), glm::vec3(0,1,0)); // Fixed camera for 2D (ortho) in XY plane
-Matrices.projection = glm::ortho(-(4.0f)/zoom+xchang, (4.0f)/zoom+xchang, (-4.0f)/zoom+ychang, (4.0f)/zoom+ychang, 0.1f, 500.0f);
+Matrices.projection = glm::ortho(-(4.0f)/s.zoom+s.xchang, (4.0f)/s.zoom+s.xchang, (-4.0f)/s.zoom+s.ychang, (4.0f)/s.zoom+s.ychang, 0.1f, 500.0f);
 
-  // Compute ViewProject matrix as view/camera might not be changed for this frame (basic scenario)
-  //  Don't change unless you are sure!!
+  // Compute ViewProject matrix
   glm::mat4 VP = Matrices.projection * Matrices.view;
+  camera.upload(s.zoom, s.xchang, s.ychang, &VP[0][0]);
+  }
 
-  // Send our transformation to the currently bound shader, in the "MVP" uniform
-  // For each model you render, since the MVP will be different (at least the M part)
-  //  Don't change unless you are sure!!
-  glm::mat4 MVP;	// MVP = Projection * View * Model
-
-  // Load identity to model matrix
- /* Matrices.model = glm::mat4(1.0f);
-
-  /* Render your scene 
-
-  glm::mat4 translateTriangle = glm::translate (glm::vec3(-2.0f, 0.0f, 0.0f)); // glTranslatef
-  glm::mat4 rotateTriangle = glm::rotate((float)(triangle_rotation*M_PI/180.0f), glm::vec3(0,0,1));  // rotate about vector (1,0,0)
-  glm::mat4 triangleTransform = translateTriangle * rotateTriangle;
-  Matrices.model *= triangleTransform; 
-  MVP = VP * Matrices.model; // MVP = p * V * M
-
-  //  Don't change unless you are sure!!
-  glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-  // draw3DObject draws the VAO given to it using current MVP matrix
-  draw3DObject(triangle);*/
-	//MIRR1
-        Matrices.model = glm::mat4(1.0f);
-        glm::mat4 translateMIRR1 = glm::translate (glm::vec3(3.0f, 0.0f, 0.0f)); // glTranslatef
-        glm::mat4 rotateMIRR1 = glm::rotate((float)(90*M_PI/180.0f), glm::vec3(0,0,1)); // rotate about vector (-1,1,1)
-        Matrices.model *= translateMIRR1*rotateMIRR1;
-        MVP = VP * Matrices.model; // MVP = p * V * M
-        glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-        srand(time(NULL));
-        draw3DObject(MIRR1);
-       //MIRR2
-        Matrices.model = glm::mat4(1.0f);
-        glm::mat4 translateMIRR2 = glm::translate (glm::vec3(2.0f, 3.0f, 0.0f)); // glTranslatef
-        glm::mat4 rotateMIRR2 = glm::rotate((float)(120*M_PI/180.0f), glm::vec3(0,0,1)); // rotate about vector (-1,1,1)
-        Matrices.model *= translateMIRR2*rotateMIRR2;
-        MVP = VP * Matrices.model; // MVP = p * V * M
-        glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-        srand(time(NULL));
-        draw3DObject(MIRR2);
-        //MIRR3
-        Matrices.model = glm::mat4(1.0f);
-        glm::mat4 translateMIRR3 = glm::translate (glm::vec3(1.0f, -2.0f, 0.0f)); // glTranslatef
-        glm::mat4 rotateMIRR3 = glm::rotate((float)(60*M_PI/180.0f), glm::vec3(0,0,1)); // rotate about vector (-1,1,1)
-        Matrices.model *= translateMIRR3*rotateMIRR3;
-        MVP = VP * Matrices.model; // MVP = p * V * M
-        glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-        srand(time(NULL));
-        draw3DObject(MIRR3);
-if(neg){
-/*neg*/ Matrices.model = glm::mat4(1.0f);
-
-  glm::mat4 translaten = glm::translate (glm::vec3(2.5, 3.45, 0));        // glTranslatef
-  //glm::mat4 rotateBasket1 = glm::rotate((float)(rectangle_rotation*M_PI/180.0f), glm::vec3(0,0,1)); // rotate about vector (-1,1,1)
-  Matrices.model *= (translaten);
-  MVP = VP * Matrices.model;
-  glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-  // draw3DObject draws the VAO given to it using current MVP matrix
-  draw3DObject(seedha);}
-if(s1)
-{
-/*seedha1*/ Matrices.model = glm::mat4(1.0f);
-
-  glm::mat4 translate1 = glm::translate (glm::vec3(3.1, 3.15, 0));        // glTranslatef
-  //glm::mat4 rotateBasket1 = glm::rotate((float)(rectangle_rotation*M_PI/180.0f), glm::vec3(0,0,1)); // rotate about vector (-1,1,1)
-  Matrices.model *= (translate1);
-  MVP = VP * Matrices.model;
-  glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-  // draw3DObject draws the VAO given to it using current MVP matrix
-  draw3DObject(seedha);}
-if(s2){
-/*seedha2*/ Matrices.model = glm::mat4(1.0f);
-
-  glm::mat4 translate2 = glm::translate (glm::vec3(3.1, 3.45, 0));        // glTranslatef
-  //glm::mat4 rotateBasket1 = glm::rotate((float)(rectangle_rotation*M_PI/180.0f), glm::vec3(0,0,1)); // rotate about vector (-1,1,1)
-  Matrices.model *= (translate2);
-  MVP = VP * Matrices.model;
-  glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-  // draw3DObject draws the VAO given to it using current MVP matrix
-  draw3DObject(seedha);}
-if(s3){
-/*seedha3*/ Matrices.model = glm::mat4(1.0f);
-
-  glm::mat4 translate3 = glm::translate (glm::vec3(3.1, 3.75, 0));        // glTranslatef
-  //glm::mat4 rotateBasket1 = glm::rotate((float)(rectangle_rotation*M_PI/180.0f), glm::vec3(0,0,1)); // rotate about vector (-1,1,1)
-  Matrices.model *= (translate3);
-  MVP = VP * Matrices.model;
-  glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-  // draw3DObject draws the VAO given to it using current MVP matrix
-  draw3DObject(seedha);}
-if(f1){
-/*tedha1*/ Matrices.model = glm::mat4(1.0f);
-
-  glm::mat4 translate11 = glm::translate (glm::vec3(3.05, 3.2, 0));        // glTranslatef
-  //glm::mat4 rotateBasket1 = glm::rotate((float)(rectangle_rotation*M_PI/180.0f), glm::vec3(0,0,1)); // rotate about vector (-1,1,1)
-  Matrices.model *= (translate11);
-  MVP = VP * Matrices.model;
-  glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-  // draw3DObject draws the VAO given to it using current MVP matrix
-  draw3DObject(tedha);}
-if(f2){
-/*tedha2*/ Matrices.model = glm::mat4(1.0f);
-
-  glm::mat4 translate12= glm::translate (glm::vec3(3.05, 3.5, 0));        // glTranslatef
-  //glm::mat4 rotateBasket1 = glm::rotate((float)(rectangle_rotation*M_PI/180.0f), glm::vec3(0,0,1)); // rotate about vector (-1,1,1)
-  Matrices.model *= (translate12);
-  MVP = VP * Matrices.model;
-  glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-  // draw3DObject draws the VAO given to it using current MVP matrix
-  draw3DObject(tedha);}
-if(f3){
-/*tedha4*/ Matrices.model = glm::mat4(1.0f);
-
-  glm::mat4 translate14 = glm::translate (glm::vec3(3.4, 3.2, 0));        // glTranslatef
-  //glm::mat4 rotateBasket1 = glm::rotate((float)(rectangle_rotation*M_PI/180.0f), glm::vec3(0,0,1)); // rotate about vector (-1,1,1)
-  Matrices.model *= (translate14);
-  MVP = VP * Matrices.model;
-  glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-  // draw3DObject draws the VAO given to it using current MVP matrix
-  draw3DObject(tedha);}
-if(f4){
-/*tedha3*/ Matrices.model = glm::mat4(1.0f);
-
-  glm::mat4 translate13= glm::translate (glm::vec3(3.4, 3.5, 0));        // glTranslatef
-  //glm::mat4 rotateBasket1 = glm::rotate((float)(rectangle_rotation*M_PI/180.0f), glm::vec3(0,0,1)); // rotate about vector (-1,1,1)
-  Matrices.model *= (translate13);
-  MVP = VP * Matrices.model;
-  glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-  // draw3DObject draws the VAO given to it using current MVP matrix
-  draw3DObject(tedha);}
-if(s4){
-/*seedha4*/ Matrices.model = glm::mat4(1.0f);
-
-  glm::mat4 translate4 = glm::translate (glm::vec3(3.6, 3.15, 0));        // glTranslatef
-  //glm::mat4 rotateBasket1 = glm::rotate((float)(rectangle_rotation*M_PI/180.0f), glm::vec3(0,0,1)); // rotate about vector (-1,1,1)
-  Matrices.model *= (translate4);
-  MVP = VP * Matrices.model;
-  glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-  // draw3DObject draws the VAO given to it using current MVP matrix
-  draw3DObject(seedha);}
-if(s5){
-/*seedha5*/ Matrices.model = glm::mat4(1.0f);
-
-  glm::mat4 translate5 = glm::translate (glm::vec3(3.6, 3.45, 0));        // glTranslatef
-  //glm::mat4 rotateBasket1 = glm::rotate((float)(rectangle_rotation*M_PI/180.0f), glm::vec3(0,0,1)); // rotate about vector (-1,1,1)
-  Matrices.model *= (translate5);
-  MVP = VP * Matrices.model;
-  glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-  // draw3DObject draws the VAO given to it using current MVP matrix
-  draw3DObject(seedha);}
-if(s6){
-/*seedha6*/ Matrices.model = glm::mat4(1.0f);
-
-  glm::mat4 translate6 = glm::translate (glm::vec3(3.6, 3.75, 0));        // glTranslatef
-  //glm::mat4 rotateBasket1 = glm::rotate((float)(rectangle_rotation*M_PI/180.0f), glm::vec3(0,0,1)); // rotate about vector (-1,1,1)
-  Matrices.model *= (translate6);
-  MVP = VP * Matrices.model;
-  glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-  // draw3DObject draws the VAO given to it using current MVP matrix
-  draw3DObject(seedha);}
-if(f21){
-/*tedha21*/ Matrices.model = glm::mat4(1.0f);
-
-  glm::mat4 translate21 = glm::translate (glm::vec3(3.55, 3.2, 0));        // glTranslatef
-  //glm::mat4 rotateBasket1 = glm::rotate((float)(rectangle_rotation*M_PI/180.0f), glm::vec3(0,0,1)); // rotate about vector (-1,1,1)
-  Matrices.model *= (translate21);
-  MVP = VP * Matrices.model;
-  glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-  // draw3DObject draws the VAO given to it using current MVP matrix
-  draw3DObject(tedha);}
-if(f22){
-/*tedha22*/ Matrices.model = glm::mat4(1.0f);
-
-  glm::mat4 translate22= glm::translate (glm::vec3(3.55, 3.5, 0));        // glTranslatef
-  //glm::mat4 rotateBasket1 = glm::rotate((float)(rectangle_rotation*M_PI/180.0f), glm::vec3(0,0,1)); // rotate about vector (-1,1,1)
-  Matrices.model *= (translate22);
-  MVP = VP * Matrices.model;
-  glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-  // draw3DObject draws the VAO given to it using current MVP matrix
-  draw3DObject(tedha);}
-if(f23){
-/*tedha24*/ Matrices.model = glm::mat4(1.0f);
-
-  glm::mat4 translate24 = glm::translate (glm::vec3(3.9, 3.2, 0));        // glTranslatef
-  //glm::mat4 rotateBasket1 = glm::rotate((float)(rectangle_rotation*M_PI/180.0f), glm::vec3(0,0,1)); // rotate about vector (-1,1,1)
-  Matrices.model *= (translate24);
-  MVP = VP * Matrices.model;
-  glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-  // draw3DObject draws the VAO given to it using current MVP matrix
-  draw3DObject(tedha);}
-if(f24){
-/*tedha23*/ Matrices.model = glm::mat4(1.0f);
-
-  glm::mat4 translate23= glm::translate (glm::vec3(3.9, 3.5, 0));        // glTranslatef
-  //glm::mat4 rotateBasket1 = glm::rotate((float)(rectangle_rotation*M_PI/180.0f), glm::vec3(0,0,1)); // rotate about vector (-1,1,1)
-  Matrices.model *= (translate23);
-  MVP = VP * Matrices.model;
-  glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-  // draw3DObject draws the VAO given to it using current MVP matrix
-  draw3DObject(tedha);}
- /*Basket 1*/ Matrices.model = glm::mat4(1.0f);
-
-  glm::mat4 translateBasket1 = glm::translate (glm::vec3(-0.5+mov1, -4, 0));        // glTranslatef
-  //glm::mat4 rotateBasket1 = glm::rotate((float)(rectangle_rotation*M_PI/180.0f), glm::vec3(0,0,1)); // rotate about vector (-1,1,1)
-  Matrices.model *= (translateBasket1);
-  MVP = VP * Matrices.model;
-  glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-  // draw3DObject draws the VAO given to it using current MVP matrix
-  draw3DObject(Basket1);
+  // Each object only sends its own placement, in the "Model" uniform;
+  // the vertex shader applies it and then the camera's VP
+  sceneFrame(s);
+        gpuTimer.begin(GPU_MIRRORS);
+        for(size_t m=0;m<s.mirrors.size();m++)
+                drawNode(nodeMirrors+m, MirrorMesh);
+        gpuTimer.end();
+/*score - one batch, rebuilt only when the score changes*/
+  gpuTimer.begin(GPU_SCORE);
+  scoreDisplay.update(s.score, glState);
+  setModel(scene.world[nodeHud]);
+  scoreDisplay.draw(glState);
+  if(latency.enabled)
+  {
+    // p99 milliseconds from click to screen over the last few shots
+    latencyDisplay.update((long long) (latency.recentPercentile(LATENCY_FIRE, 99)/1000+0.5), glState);
+    latencyDisplay.draw(glState);
+  }
+  glState.bindVertexArray (meshBuffer.VertexArrayID);
+  gpuTimer.end();
+  gpuTimer.begin(GPU_BASKETS);
+ /*Basket 1*/ drawNode(nodeBasket1, Basket1);
 	
-  /*Basket 2*/Matrices.model = glm::mat4(1.0f);
-
-  glm::mat4 translateBasket2 = glm::translate (glm::vec3(0.5+mov2, -4, 0));        // glTranslatef
-  //glm::mat4 rotateBasket2 = glm::rotate((float)(rectangle_rotation*M_PI/180.0f), glm::vec3(0,0,1)); // rotate about vector (-1,1,1)
-  Matrices.model *= (translateBasket2);
-  MVP = VP * Matrices.model;
-  glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-  // draw3DObject draws the VAO given to it using current MVP matrix
-  draw3DObject(Basket2);
+  /*Basket 2*/drawNode(nodeBasket2, Basket2);
+  gpuTimer.end();
   
-  /*cannonBase */Matrices.model = glm::mat4(1.0f);
-
-  glm::mat4 translateCannonBase = glm::translate (glm::vec3(-4, 0+movcannon, 0));        // glTranslatef
-  //glm::mat4 rotateCannonBase = glm::rotate((float)(rectangle_rotation*M_PI/180.0f), glm::vec3(0,0,1)); // rotate about vector (-1,1,1)
-  Matrices.model *= (translateCannonBase);
-  MVP = VP * Matrices.model;
-  glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-  // draw3DObject draws the VAO given to it using current MVP matrix
-  draw3DObject(CannonBase);
+  gpuTimer.begin(GPU_CANNON);
+  /*cannonBase */drawNode(nodeCannonBase, CannonBase);
   
-  /*cannonFace */Matrices.model = glm::mat4(1.0f);
-
-  glm::mat4 translateCannonFace = glm::translate (glm::vec3(-3.75, 0+movcannon, 0));        // glTranslatef
-  glm::mat4 rotateCannonFace = glm::rotate((float)(rotatecannon*M_PI/180.0f), glm::vec3(0,0,1)); // rotate about vector (-1,1,1)
-  Matrices.model *= (translateCannonFace*rotateCannonFace);
-  MVP = VP * Matrices.model;
-  glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-  // draw3DObject draws the VAO given to it using current MVP matrix
-  draw3DObject(CannonFace);
+  /*cannonFace */drawNode(nodeCannonFace, CannonFace);
   
-  /*Line */Matrices.model = glm::mat4(1.0f);
-
-  glm::mat4 translateLine = glm::translate (glm::vec3(0, -3, 0));        // glTranslatef
-  //glm::mat4 rotateCannonFace = glm::rotate((float)(rotatecannon*M_PI/180.0f), glm::vec3(0,0,1)); // rotate about vector (-1,1,1)
-  Matrices.model *= (translateLine);
-  MVP = VP * Matrices.model;
-  glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-  // draw3DObject draws the VAO given to it using current MVP matrix
-  draw3DObject(Line);
-/*bullet*/
-	long long int i;
-
-for(i=0;i<count;i++)
+  /*Line */drawNode(nodeLine, Line);
+  gpuTimer.end();
+/*bullets and bricks - one instanced draw each*/
+  glState.useProgram (instancedProgramID);
+  size_t i;
+  gpuTimer.begin(GPU_BULLETS);
+  beginInstanceBatch(BulletBatch, s.bullet_x.size());
+  for(i=0;i<s.bullet_x.size();i++)
   {
-	if(FLAG_GOLI[i]==0){
-  Matrices.model = glm::mat4(1.0f);
-  glm::mat4 translateBrick = glm::translate (glm::vec3(bulletx[i], YBULLET[i], 0));  // glTranslatef
-  glm::mat4 translate1 = glm::translate (glm::vec3(-3.75, CANNONY[i], 0));  // glTranslatef
-  glm::mat4 translate2 = glm::translate (glm::vec3(3.75, 0, 0));  // glTranslatef
-  glm::mat4 rotateBullet = glm::rotate((float)((ROTATEBULLET[i])*M_PI/180.0f), glm::vec3(0,0,1)); // rotate about vector (-1,1,1)
-  Matrices.model *= (translateBrick*translate1*rotateBullet);
-  MVP = VP * Matrices.model;
-  glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-  draw3DObject(Bullet);
-	}
-
+    float x=s.bullet_px[i]+(s.bullet_x[i]-s.bullet_px[i])*alpha;
+    float y=s.bullet_py[i]+(s.bullet_y[i]-s.bullet_py[i])*alpha;
+    addInstance(BulletBatch, x, y, s.bullet_angle[i]*M_PI/180.0f, 0, 0, 1);
   }
-/*bocks*/
-  for(i=0;i<countred;i++)
+  drawInstanceBatch(BulletBatch);
+  gpuTimer.end();
+  gpuTimer.begin(GPU_BRICKS);
+  beginInstanceBatch(BrickBatch, s.brick_x.size());
+  for(i=0;i<s.brick_x.size();i++)
   {
-	
-		if(flagred[i]==0)
-	{
-	int flag=0;
-	if(redy[i]<=(-3))
-		flag=1;
-	if((redy[i]<=(-3) && red[i]<=(2.5+mov2)) || (redy[i]<=(-3) && (red[i] +0.2)>=(0.5+mov2)))
-		{
-			flag=1;
-			score+=1;
-			flagred[i]=1;
-		}
-  Matrices.model = glm::mat4(1.0f);
-  glm::mat4 translateBrick = glm::translate (glm::vec3(red[i], redy[i], 0));  // glTranslatef
-  Matrices.model *= (translateBrick);
-  MVP = VP * Matrices.model;
-  glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-	if(flag==0)
-  draw3DObject(Red);
-	}
+    if(s.brick_type[i]==BRICK_RED)
+      addInstance(BrickBatch, s.brick_x[i], s.brick_y[i], 0, 1, 0, 0);
+    else if(s.brick_type[i]==BRICK_BLACK)
+      addInstance(BrickBatch, s.brick_x[i], s.brick_y[i], 0, 0, 0, 0);
+    else
+      addInstance(BrickBatch, s.brick_x[i], s.brick_y[i], 0, 0, 1, 0);
   }
-  for(i=0;i<countblack;i++)
-  { 
-  if(flagblack[i]==0)
+  drawInstanceBatch(BrickBatch);
+  gpuTimer.end();
+  streamBuffer.endFrame();
+
+  // Swap the frame buffers
   {
-	int flag=0;
-	if((blacky[i]<=(-3) && black[i]<=(-0.5+mov1)) || (blacky[i]<=(-3) && (black[i] +0.2)>=(-2.5+mov1)))
-		flag=1;
-	if((blacky[i]<=(-3) && black[i]<=(2.5+mov2)) || (blacky[i]<=(-3) && (black[i] +0.2)>=(0.5+mov2)))
-		flag=1;
-  Matrices.model = glm::mat4(1.0f);
-  glm::mat4 translateStone = glm::translate (glm::vec3(black[i], blacky[i], 0));  // glTranslatef
-  Matrices.model *= (translateStone);
-  MVP = VP * Matrices.model;
-  glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-	if(flag==0)
-  draw3DObject(Black);
-	else
-		{
-	cout << score <<"\n";
-	cout << "GAME OVER\n";
-	exit(0);
-	   }
-	}
+    ProfileScope swapScope(profiler, PHASE_SWAP);
+    if(offscreen)
+      glFinish ();  // no window to swap; wait for the frame so timings are real
+    else
+      glutSwapBuffers ();
   }
-  for(i=0;i<countgreen;i++)
-  {
-	if(FLAG_GRN[i]==0)
-	{
-	int flag=0;
-	if((greeny[i]<=(-3) && green[i]<=(-0.5+mov1)) || (greeny[i]<=(-3) && (green[i] +0.2)>=(-2.5+mov1)))
-		{
-			flag=1;
-			score+=1;
-			FLAG_GRN[i]=1;
-		}
-	if(greeny[i]<=(-3))
-		flag=1;
-  Matrices.model = glm::mat4(1.0f);
-  glm::mat4 translateGrass = glm::translate (glm::vec3(green[i], greeny[i], 0));  // glTranslatef
-  Matrices.model *= (translateGrass);
-  MVP = VP * Matrices.model;
-  glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-	if(flag==0)
-  draw3DObject(Green);
-	} 
- }
-long long int j;
-        float cx,bx,cy,by,w,bw;
-        for(i=0;i<count;i++)
-        {
-                cx=-3.75+bulletx[i];
-                cy=CANNONY[i]+YBULLET[i];
-                w=0.05;
-                if(FLAG_GOLI[i]==0 && FLAG_GOLIMIRR1[i]==0)
-                {
-                                        bx=3;
-                                        by=0;
-                                        bw=0.025;
-                                        if((abs(bx-cx)<=w+bw) && (abs(by-cy)<=w+0.4))
-                                        {
-                                                FLAG_GOLIMIRR1[i]=1;
-                                                ROTATEBULLET[i]=2*90-ROTATEBULLET[i];
-                                                break;
-                                        }
-                }
-		if(FLAG_GOLI[i]==0 && FLAG_GOLIMIRR2[i]==0)
-                {
-                                        bx=2;
-                                        by=3;
-                                        bw=0;
-                                        if((abs(bx-cx)<=w+bw) && (abs(by-cy)<=w+0.3))
-                                        {
-                                                FLAG_GOLIMIRR2[i]=1;
-                                                ROTATEBULLET[i]=2*120-ROTATEBULLET[i];
-                                                break;
-                                        }
-
-
-
-
-                }
-                if(FLAG_GOLI[i]==0 && FLAG_GOLIMIRR3[i]==0)
-                {
-                                        bx=1;
-                                        by=-2;
-                                        bw=0;
-                                        if((abs(bx-cx)<=w+bw) && (abs(by-cy)<=w+0.3))
-                                        {
-                                                FLAG_GOLIMIRR3[i]=1;
-                                                ROTATEBULLET[i]=2*60-ROTATEBULLET[i];
-                                                break;
-                                        }
-
-                }
-
-	}
+  if(latency.enabled)
+    latency.presented(s.tick, steadyMicros());
+	
 
+  // Increment angles
+  //float increments = 1;
 
-        for(i=0;i<count;i++)
-        {
-                cx=-3.75+bulletx[i];
-                cy=CANNONY[i]+YBULLET[i];
-                w=0.01;
-                if(FLAG_GOLI[i]==0)
-                {
-                        for(j=0;j<countblack;j++)
-                        {
-                                if(flagblack[i]==0)
-                                {
-                                        bx=black[j];
-                                        by=blacky[j];
-                                        if((abs(bx-cx)<=0.075) && (abs(by-cy)<=0.3))
-                                        {
-                                                FLAG_GOLI[i]=1;
-                                                flagblack[j]=1;
-                                             //   perfect shoot
-                                                score+=2;
-                                                break;
-
-                                        }
-                                }
+  //camera_rotation_angle++; // Simulating camera rotation
+  //triangle_rotation = triangle_rotation + increments*triangle_rot_dir*triangle_rot_status;
+  //rectangle_rotation = rectangle_rotation + increments*rectangle_rot_dir*rectangle_rot_status;
+}
 
-                        }
-                }
-                if(FLAG_GOLI[i]==0)
-                {
-                        for(j=0;j<countred;j++)
-                        {
-                                if(flagred[i]==0)
-                                {
-                                        bx=red[j];
-                                        by=redy[j];
-                                        //bw=0.1;
-                                        if((abs(bx-cx)<=0.075) && (abs(by-cy)<=0.3))
-                                        {
-                                                FLAG_GOLI[i]=1;
-                                                flagred[j]=1;
-                                     		score-=2;
-                                                break;
+/* Move the bullets along their firing angle, retire the ones that leave the screen */
+void integrate ()
+{
+	integrator.run(bullets, level.mirrors, BULLET_SPEED/sim_hz);
+}
 
-                                        }
-                                }
+/* Fingerprint of everything the simulation owns */
+uint64_t hashState (uint64_t h)
+{
+	h=hashBytes(h, &score, sizeof(score));
+	size_t n=bricks.size();
+	h=hashBytes(h, &n, sizeof(n));
+	if(n)
+	{
+		h=hashBytes(h, &bricks.x[0], n*sizeof(float));
+		h=hashBytes(h, &bricks.y[0], n*sizeof(float));
+		h=hashBytes(h, &bricks.type[0], n);
+	}
+	n=bullets.size();
+	h=hashBytes(h, &n, sizeof(n));
+	if(n)
+	{
+		h=hashBytes(h, &bullets.x[0], n*sizeof(float));
+		h=hashBytes(h, &bullets.y[0], n*sizeof(float));
+		h=hashBytes(h, &bullets.angle[0], n*sizeof(float));
+	}
+	return h;
+}
 
+/* One step of game logic - no GL calls, safe to run without a window */
+void simTick ()
+{
+	drainInput();
+	{
+		ProfileScope scope(profiler, PHASE_INTEGRATE);
+		integrate();
+	}
+	{
+		ProfileScope scope(profiler, PHASE_SPAWN);
+		declare();
+	}
+	{
+		ProfileScope scope(profiler, PHASE_COLLIDE);
+		collide();
+	}
+	if(score>=100)
+		gameOver("YOU WON");
+	sim_ticks++;
+	sim_time+=1000.0/sim_hz;
+	if(hashing)
+		state_hash=hashState(state_hash);
+	if(game_over)
+		endGame();
+}
 
+/* Run however many fixed steps the clock says are due, and set render_alpha
+   to how far we are into the next one. Falls behind gracefully: at most
+   MAX_STEPS_PER_FRAME steps per call, the rest of the backlog is dropped. */
+void advanceSimulation ()
+{
+	long long now=gameClock();
+	double tick_ms=1000.0/sim_hz;
+	sim_accumulator+=now-sim_last_clock;
+	sim_last_clock=now;
+	int steps=0;
+	while(sim_accumulator>=tick_ms && steps<MAX_STEPS_PER_FRAME && !game_over)
+	{
+		simTick();
+		sim_accumulator-=tick_ms;
+		steps++;
+	}
+	if(sim_accumulator>=tick_ms)
+		sim_accumulator=0;
+	render_alpha=sim_accumulator/tick_ms;
+}
 
-                        }
-                }
-                 if(FLAG_GOLI[i]==0)
-                {
-                        for(j=0;j<countgreen;j++)
-                        {
-                                if(FLAG_GRN[i]==0)
-                                {
-                                        bx=green[j];
-                                        by=greeny[j];
-                                        bw=0.1;
-                                        if((abs(bx-cx)<=0.075) && (abs(by-cy)<=0.3))
-                                        {
-                                                FLAG_GOLI[i]=1;
-                                                FLAG_GRN[j]=1;
-                                              	score-=2;
-                                                break;
+/* Record the frame interval and show the live numbers in the window title */
+double last_frame_start=-1,last_title_update=0;
+double shown_collide_us=0;    // from the snapshot last drawn; collide may be timed on the sim thread
+void profilerFrame ()
+{
+	if(!profiler.enabled)
+		return;
+	double now=profiler.now();
+	if(last_frame_start>=0)
+		profiler.record(PHASE_FRAME, last_frame_start, now-last_frame_start);
+	last_frame_start=now;
+	if(!headless && now-last_title_update>=500000)
+	{
+		char title[256];
+		snprintf(title, sizeof(title), "frame %.2f ms (p99 %.2f) | collide %.0f us (last) | render %.0f us | swap %.0f us | gl %lld/%lld elided",
+			profiler.percentile(PHASE_FRAME, 50)/1000, profiler.percentile(PHASE_FRAME, 99)/1000,
+			shown_collide_us, profiler.percentile(PHASE_RENDER, 50), profiler.percentile(PHASE_SWAP, 50),
+			glState.last_elided, glState.last_issued+glState.last_elided);
+		glutSetWindowTitle(title);
+		last_title_update=now;
+	}
+}
 
-                                        }
-                                }
+/* Load --level into the game, keeping the current layout if the file is bad */
+bool reloadLevel ()
+{
+	std::string error;
+	level_stamp=fileStamp(level_path);
+	if(!loadLevel(level_path, level, error))
+	{
+		cout << "level: " << level_path << ": " << error << endl;
+		return false;
+	}
+	// mirror indices from the old layout mean nothing now
+	for(size_t i=0;i<bullets.size();i++)
+		bullets.last_mirror[i]=-1;
+	cout << "level: loaded " << level_path << ", " << level.mirrors.size() << " mirrors" << endl;
+	return true;
+}
 
+/* Hot reload - check the level file twice a second and pick up any edit.
+   Off while recording, since a journal does not capture the layout. */
+void pollLevel ()
+{
+	static long long last_poll=0;
+	if(!level_path || journal.file)
+		return;
+	long long now=gameClock();
+	if(now-last_poll<500)
+		return;
+	last_poll=now;
+	if(fileStamp(level_path)!=level_stamp)
+		reloadLevel();
+}
 
+/* Copy what draw() needs out of the simulation */
+void capture (Snapshot& s)
+{
+	s.tick=sim_ticks;
+	s.published_ms=gameClock();
+	s.alpha=render_alpha;
+	s.score=score;
+	s.game_over=game_over;
+	s.collide_us=profiler.last(PHASE_COLLIDE);
+	s.mov1=mov1;
+	s.mov2=mov2;
+	s.movcannon=movcannon;
+	s.rotatecannon=rotatecannon;
+	s.zoom=zoom;
+	s.xchang=xchang;
+	s.ychang=ychang;
+	s.basket_width[0]=level.basket_width[0];
+	s.basket_width[1]=level.basket_width[1];
+	s.mirrors=level.mirrors;
+	s.brick_x=bricks.x;
+	s.brick_y=bricks.y;
+	s.brick_type=bricks.type;
+	size_t n=bullets.size();
+	s.bullet_x.assign(bullets.x.begin(), bullets.x.begin()+n);
+	s.bullet_y.assign(bullets.y.begin(), bullets.y.begin()+n);
+	s.bullet_px.assign(bullets.px.begin(), bullets.px.begin()+n);
+	s.bullet_py.assign(bullets.py.begin(), bullets.py.begin()+n);
+	s.bullet_angle.assign(bullets.angle.begin(), bullets.angle.begin()+n);
+}
 
-                        }
-                }
+/* Simulation thread - owns every piece of game state while it runs and
+   hands the renderer a snapshot after each batch of ticks */
+TripleBuffer<Snapshot> snapshots;
+std::thread simThread;
+std::atomic<bool> sim_running(false);
 
-        }
+void simLoop ()
+{
+	while(sim_running.load(std::memory_order_acquire))
+	{
+		pollLevel();
+		long long before=sim_ticks;
+		advanceSimulation();
+		if(sim_ticks!=before)
+		{
+			capture(snapshots.writable());
+			snapshots.publish();
+		}
+		if(game_over)
+			break;
+		// sleep until the next tick is due
+		double wait_ms=1000.0/sim_hz-sim_accumulator;
+		std::this_thread::sleep_for(std::chrono::microseconds((long long) (max(wait_ms, 0.0)*1000)));
+	}
+}
 
-  // Swap the frame buffers
-  glutSwapBuffers ();
-	
+void startSimThread ()
+{
+	gameClock=steadyClock;
+	sim_last_clock=gameClock();
+	capture(snapshots.writable());
+	snapshots.publish();
+	sim_running.store(true, std::memory_order_release);
+	simThread=std::thread(simLoop);
+}
 
-  // Increment angles
-  //float increments = 1;
+/* Stop and join the simulation before anything at exit reads its state */
+void stopSimThread ()
+{
+	sim_running.store(false, std::memory_order_release);
+	if(simThread.joinable())
+		simThread.join();
+}
 
-  //camera_rotation_angle++; // Simulating camera rotation
-  //triangle_rotation = triangle_rotation + increments*triangle_rot_dir*triangle_rot_status;
-  //rectangle_rotation = rectangle_rotation + increments*rectangle_rot_dir*rectangle_rot_status;
+/* Draw the newest snapshot, or the live state when there is no simulation thread */
+Snapshot frameSnapshot;
+void render ()
+{
+	if(!sim_threaded)
+	{
+		capture(frameSnapshot);
+		shown_collide_us=frameSnapshot.collide_us;
+		draw(frameSnapshot, render_alpha);
+		return;
+	}
+	snapshots.acquire();
+	const Snapshot& s=snapshots.readable();
+	if(s.game_over)
+	{
+		cout << s.score <<"\n";
+		cout << s.game_over << "\n";
+		exit(0);
+	}
+	shown_collide_us=s.collide_us;
+	// keep interpolating by the time that has passed since it was published
+	float alpha=s.alpha+(gameClock()-s.published_ms)*sim_hz/1000.0f;
+	draw(s, min(alpha, 1.0f));
 }
 
 /* Executed when the program is idle (no I/O activity) */
@@ -1548,229 +1549,162 @@ void idle () {
     // OpenGL should never stop drawing
     // can draw the same scene or a modified scenei
 //bulletx[0]=-3.75;
-int a,b,s;
-if(score>=100)
-{
-	cout << score <<"\n";
-	cout << "YOU WON\n";
-	exit(0);
-}
-if(score<0)
-{
-	neg=1;
-	s=score*-1;
-}
-else
-{
-	neg=0;
-	s=score;
-}
-b=s%10;
-a=s/10;
-switch(a)
-{
-case 0:
-	f1=1;
-	f2=1;
-	f3=1;
-	f4=1;
-	s1=1;
-	s2=0;
-	s3=1;
-	break;
-case 1:
-	f1=0;
-	f2=0;
-	f3=1;
-	f4=1;
-	s1=0;
-	s2=0;
-	s3=0;
-	break;
-case 2:
-	f1=1;
-	f2=0;
-	f3=0;
-	f4=1;
-	s1=1;
-	s2=1;
-	s3=1;
-	break;
-case 3:
-	f1=0;
-	f2=0;
-	f3=1;
-	f4=1;
-	s1=1;
-	s2=1;
-	s3=1;
-	break;
-case 4:
-	f1=0;
-	f2=1;
-	f3=1;
-	f4=1;
-	s1=0;
-	s2=1;
-	s3=0;
-	break;
-case 5:
-	f1=0;
-	f2=1;
-	f3=1;
-	f4=0;
-	s1=1;
-	s2=1;
-	s3=1;
-	break;
-case 6:
-	f1=1;
-	f2=1;
-	f3=1;
-	f4=0;
-	s1=1;
-	s2=1;
-	s3=1;
-	break;
-case 7:
-	f1=0;
-	f2=0;
-	f3=1;
-	f4=1;
-	s1=0;
-	s2=0;
-	s3=1;
-	break;
-case 8:
-	f1=1;
-	f2=1;
-	f3=1;
-	f4=1;
-	s1=1;
-	s2=1;
-	s3=1;
-	break;
-case 9:
-	f1=0;
-	f2=1;
-	f3=1;
-	f4=1;
-	s1=1;
-	s2=1;
-	s3=1;
-	break;
-default:
-	break;
-}
-switch(b)
-{
-case 0:
-	f21=1;
-	f22=1;
-	f23=1;
-	f24=1;
-	s4=1;
-	s5=0;
-	s6=1;
-	break;
-case 1:
-	f21=0;
-	f22=0;
-	f23=1;
-	f24=1;
-	s4=0;
-	s5=0;
-	s6=0;
-	break;
-case 2:
-	f21=1;
-	f22=0;
-	f23=0;
-	f24=1;
-	s4=1;
-	s5=1;
-	s6=1;
-	break;
-case 3:
-	f21=0;
-	f22=0;
-	f23=1;
-	f24=1;
-	s4=1;
-	s5=1;
-	s6=1;
-	break;
-case 4:
-	f21=0;
-	f22=1;
-	f23=1;
-	f24=1;
-	s4=0;
-	s5=1;
-	s6=0;
-	break;
-case 5:
-	f21=0;
-	f22=1;
-	f23=1;
-	f24=0;
-	s4=1;
-	s5=1;
-	s6=1;
-	break;
-case 6:
-	f21=1;
-	f22=1;
-	f23=1;
-	f24=0;
-	s4=1;
-	s5=1;
-	s6=1;
-	break;
-case 7:
-	f21=0;
-	f22=0;
-	f23=1;
-	f24=1;
-	s4=0;
-	s5=0;
-	s6=1;
-	break;
-case 8:
-	f21=1;
-	f22=1;
-	f23=1;
-	f24=1;
-	s4=1;
-	s5=1;
-	s6=1;
-	break;
-case 9:
-	f21=0;
-	f22=1;
-	f23=1;
-	f24=1;
-	s4=1;
-	s5=1;
-	s6=1;
-	break;
-default:
-	break;
-}
-int i;
-float angle=rotatecannon;
-for(i=0;i<count;i++)
-{		if(YBULLET[i]+CANNONY[i]<=4 && YBULLET[i]+CANNONY[i]>=-3 )
-	        YBULLET[i]+=0.1*sin((ROTATEBULLET[i]*M_PI)/180.0f);
-		else FLAG_GOLI[i]=1;
-		if(bulletx[i]-3.75<=4 && bulletx[i]-3.75>=-4)
-                bulletx[i]+=0.1*cos((ROTATEBULLET[i]*M_PI)/180.0f);
-		else FLAG_GOLI[i]=1;
+renderArena.reset();
+profilerFrame();
+if(!sim_threaded)
+{
+	pollLevel();
+	advanceSimulation();
 }
-	declare();
-    draw (); // drawing same scene
+    render (); // drawing same scene
+}
+
+/* Frame pacing - redraw from a GLUT timer instead of spinning in the idle callback */
+int max_fps=120;
+void frameTimer (int value)
+{
+	glutTimerFunc (1000/max_fps, frameTimer, 0);
+	idle ();
+}
+
+/* The headless bot - sweep the barrel across its range and keep firing */
+void botInput (long long t)
+{
+	submitInput(INPUT_AIM, 0, 0, ((t/10)%19)*10-90, 0);
+	submitInput(INPUT_KEY_UP, ' ', 0, 0, 0);
+}
+
+/* Headless mode: drive simTick() from the virtual clock with a simple firing bot */
+void runHeadless (long long ticks, long long tick_ms)
+{
+	gameClock = virtualClock;
+	auto start = std::chrono::steady_clock::now();
+	for(long long t=0;t<ticks;t++)
+	{
+		virtual_time+=tick_ms;
+		renderArena.reset();
+		botInput(t);
+		profilerFrame();
+		advanceSimulation();
+	}
+	double wall = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+	cout << "headless: " << ticks << " frames, " << sim_ticks << " ticks at " << sim_hz << " Hz, " << sim_time/1000.0 << " s simulated, " << wall << " s wall\n";
+	cout << "headless: " << (wall>0 ? sim_ticks/wall : 0) << " ticks/s, " << games_played << " games, " << bullets_fired << " bullets fired, score " << score << "\n";
+}
+
+void initGL (int width, int height);
+
+/* Offscreen mode: the headless game and bot, with every frame drawn into an
+   EGL framebuffer - no window or display server needed. Optionally writes
+   every frame_every'th frame to frame_dir as PNG. */
+int runOffscreen (long long frames, long long tick_ms, int width, int height)
+{
+	OffscreenContext context;
+	std::string error;
+	if(!context.create(width, height, error))
+	{
+		cout << "offscreen: " << error << endl;
+		return 1;
+	}
+	glewExperimental = GL_TRUE;
+	GLenum err = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+	// a GLX build of GLEW loads the GL entry points, then fails to find an X display
+	if (err == GLEW_ERROR_NO_GLX_DISPLAY)
+		err = GLEW_OK;
+#endif
+	if (err != GLEW_OK) {
+		cout << "Error: Failed to initialise GLEW : "<< glewGetErrorString(err) << endl;
+		return 1;
+	}
+	if(!context.init(error))
+	{
+		cout << "offscreen: " << error << endl;
+		return 1;
+	}
+	initGL(width, height);
+	if(frame_dir)
+		mkdir(frame_dir, 0755);
+
+	gameClock = virtualClock;
+	PngWriter png;
+	std::vector<unsigned char> pixels;
+	long long written=0;
+	double drawing=0;
+	auto start = std::chrono::steady_clock::now();
+	for(long long t=0;t<frames;t++)
+	{
+		virtual_time+=tick_ms;
+		renderArena.reset();
+		botInput(t);
+		profilerFrame();
+		advanceSimulation();
+		auto frame_start = std::chrono::steady_clock::now();
+		render();
+		drawing+=std::chrono::duration<double>(std::chrono::steady_clock::now()-frame_start).count();
+		if(frame_dir && t%frame_every==0)
+		{
+			char path[1024];
+			snprintf(path, sizeof(path), "%s/frame_%06lld.png", frame_dir, t);
+			context.readPixels(pixels);
+			if(png.write(path, width, height, &pixels[0]))
+				written++;
+			else
+				cout << "offscreen: cannot write " << path << "\n";
+		}
+	}
+	double wall = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+	cout << "offscreen: " << frames << " frames at " << width << "x" << height << " in " << wall << " s, "
+	     << (wall>0 ? frames/wall : 0) << " fps, " << (drawing>0 ? frames/drawing : 0) << " fps drawing only\n";
+	if(frame_dir)
+		cout << "offscreen: " << written << " frames written to " << frame_dir << "\n";
+	context.destroy();
+	return 0;
+}
+
+/* Replay a recorded session as fast as possible and check it ends in the same state */
+int runReplay (const char* path)
+{
+	std::vector<InputEvent> events;
+	InputEvent end;
+	uint64_t expected=0;
+	Journal in;
+	if(!in.read(path, events, end, expected))
+	{
+		cout << "replay: cannot read " << path << "\n";
+		return 1;
+	}
+	headless=true;
+	hashing=true;
+	sim_hz=in.sim_hz;
+	gameRng.seed(in.seed);
+	resetGame();
+
+	auto start = std::chrono::steady_clock::now();
+	size_t next=0;
+	while(sim_ticks<end.tick)
+	{
+		renderArena.reset();
+		while(next<events.size() && events[next].tick==sim_ticks)
+			applyInput(events[next++]);
+		simTick();
+	}
+	double wall = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+	cout << "replay: " << sim_ticks << " ticks, " << events.size() << " inputs, " << sim_time/1000.0 << " s of play in " << wall << " s (" << (wall>0 ? sim_time/1000.0/wall : 0) << "x real time)\n";
+	if(state_hash!=expected)
+	{
+		cout << "replay: MISMATCH - final state differs from the recording\n";
+		return 1;
+	}
+	cout << "replay: match, score " << score << "\n";
+	return 0;
 }
 
+/* Finish the journal however the session ends */
+void closeJournal ()
+{
+	journal.close(sim_ticks, state_hash);
+}
 
 /* Initialise glut window, I/O callbacks and the renderer to use */
 /* Nothing to Edit here */
@@ -1806,8 +1740,8 @@ void initGLUT (int& argc, char** argv, int width, int height)
 
     glutReshapeFunc (reshapeWindow);
 
-    glutDisplayFunc (draw); // function to draw when active
-    glutIdleFunc (idle); // function to draw when idle (no I/O activity)
+    glutDisplayFunc (render); // function to draw when active
+    glutTimerFunc (1000/max_fps, frameTimer, 0); // redraw at most max_fps times a second
     
     glutIgnoreKeyRepeat (true); // Ignore keys held down
 }
@@ -1847,8 +1781,15 @@ void initGL (int width, int height)
 
 	// Create and compile our GLSL program from the shaders
 	programID = LoadShaders( "Sample_GL.vert", "Sample_GL.frag" );
-	// Get a handle for our "MVP" uniform
-	Matrices.MatrixID = glGetUniformLocation(programID, "MVP");
+	// Get a handle for our "Model" uniform
+	Matrices.ModelID = glGetUniformLocation(programID, "Model");
+	// Bricks and bullets are drawn instanced with their own program
+	instancedProgramID = LoadShaders( "Sample_GL_instanced.vert", "Sample_GL.frag" );
+	// both read the view-projection from one uniform buffer
+	camera.init();
+	camera.attach(programID);
+	camera.attach(instancedProgramID);
+	gpuTimer.init();
 
 
 	reshapeWindow (width, height);
@@ -1865,16 +1806,17 @@ void initGL (int width, int height)
 	createCannonBase ();
 	createCannonFace ();
 	createRed();
-	createGreen();
-	createBlack();
 	createBullet();
-	createMIRR1();
-	createMIRR2();
-	createMIRR3();
+	createMirror();
 	createLine();
 	createBoard();
-	createseedha();
-	createtedha();
+	uploadMeshes();
+	buildScene();
+	scoreDisplay.init(glState);
+	streamBuffer.init(glState, 1<<20);
+	latencyDisplay.init(glState);
+	BrickBatch = createInstanceBatch(Red);
+	BulletBatch = createInstanceBatch(Bullet);
 	cout << "VENDOR: " << glGetString(GL_VENDOR) << endl;
 	cout << "RENDERER: " << glGetString(GL_RENDERER) << endl;
 	cout << "VERSION: " << glGetString(GL_VERSION) << endl;
@@ -1885,7 +1827,103 @@ int main (int argc, char** argv)
 {
 	int width = 800;
 	int height = 800;
+	long long ticks=100000,tick_ms=16;
+	bool ticks_given=false;
+	bool single_thread=false;
+	const char* record_path=NULL;
+	const char* replay_path=NULL;
+	for(int i=1;i<argc;i++)
+	{
+		if(strcmp(argv[i],"--headless")==0)
+			headless=true;
+		else if(strcmp(argv[i],"--offscreen")==0)
+			offscreen=headless=true;
+		else if(strcmp(argv[i],"--frames")==0 && i+1<argc)
+			frame_dir=argv[++i];
+		else if(strcmp(argv[i],"--frame-every")==0 && i+1<argc)
+			frame_every=max(1, atoi(argv[++i]));
+		else if(strcmp(argv[i],"--ticks")==0 && i+1<argc)
+		{
+			ticks=atoll(argv[++i]);
+			ticks_given=true;
+		}
+		else if(strcmp(argv[i],"--tick-ms")==0 && i+1<argc)
+			tick_ms=atoll(argv[++i]);
+		else if(strcmp(argv[i],"--hz")==0 && i+1<argc)
+			sim_hz=max(1, atoi(argv[++i]));
+		else if(strcmp(argv[i],"--single-thread")==0)
+			single_thread=true;
+		else if(strcmp(argv[i],"--fps")==0 && i+1<argc)
+			max_fps=max(1, atoi(argv[++i]));
+		else if(strcmp(argv[i],"--seed")==0 && i+1<argc)
+			game_seed=strtoull(argv[++i], NULL, 10);
+		else if(strcmp(argv[i],"--record")==0 && i+1<argc)
+			record_path=argv[++i];
+		else if(strcmp(argv[i],"--replay")==0 && i+1<argc)
+			replay_path=argv[++i];
+		else if(strcmp(argv[i],"--level")==0 && i+1<argc)
+			level_path=argv[++i];
+		else if(strcmp(argv[i],"--compile-level")==0 && i+2<argc)
+		{
+			// text level in, binary level out, nothing else
+			Level compiled;
+			std::string error;
+			if(!loadLevel(argv[i+1], compiled, error))
+			{
+				cout << "level: " << argv[i+1] << ": " << error << endl;
+				return 1;
+			}
+			if(!saveLevel(argv[i+2], compiled))
+			{
+				cout << "level: cannot write " << argv[i+2] << endl;
+				return 1;
+			}
+			return 0;
+		}
+		else if(strcmp(argv[i],"--no-shader-cache")==0)
+			shaderCache.enabled=false;
+		else if(strcmp(argv[i],"--no-persistent-map")==0)
+			streamBuffer.allow_persistent=false;
+		else if(strcmp(argv[i],"--gpu-timing")==0)
+			gpuTimer.enabled=true;
+		else if(strcmp(argv[i],"--latency")==0)
+			latency.enabled=true;
+		else if(strcmp(argv[i],"--arena-stats")==0)
+			arena_stats=renderArena.debug=true;
+		else if(strcmp(argv[i],"--profile")==0)
+			profiler.enabled=true;
+		else if(strcmp(argv[i],"--trace")==0 && i+1<argc)
+		{
+			profiler.enabled=true;
+			trace_path=argv[++i];
+		}
+	}
+	renderArena.bind();
 	initialise();
+	if(level_path && !reloadLevel())
+		return 1;
+	atexit(profilerExit);
+	if(replay_path)
+		return runReplay(replay_path);
+	gameRng.seed(game_seed);
+	if(record_path)
+	{
+		if(!journal.openWrite(record_path, game_seed, sim_hz))
+		{
+			cout << "Error: cannot write " << record_path << endl;
+			exit (1);
+		}
+		hashing=true;
+		atexit(closeJournal);
+	}
+	if(offscreen)
+		return runOffscreen(ticks_given ? ticks : 600, tick_ms, width, height);
+	if(headless)
+	{
+		latency.enabled=false;  // nothing reaches a screen
+		runHeadless(ticks, tick_ms);
+		return 0;
+	}
 	/*long long int cur=0,time;
 	time=glutGet(GLUT_ELAPSED_TIME);
 	if(cur!=time){
@@ -1900,6 +1938,12 @@ int main (int argc, char** argv)
 
 	initGL (width, height);
 
+	if(!single_thread)
+	{
+		sim_threaded=true;
+		startSimThread();
+		atexit(stopSimThread);  // runs first, before the journal and profiler read the state
+	}
     glutMainLoop ();
 
     return 0;
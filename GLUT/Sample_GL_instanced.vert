@@ -0,0 +1,30 @@
+#version 330 core
+
+// input data : per vertex from the shared mesh
+layout (location = 0) in vec3 vertexPosition;
+// input data : per instance - x, y offset and rotation (radians), flat color
+layout (location = 2) in vec3 instanceTransform;
+layout (location = 3) in vec3 instanceColor;
+
+// view-projection, shared with Sample_GL.vert
+layout (std140) uniform Camera {
+    mat4 VP;
+};
+
+// output data : used by fragment shader
+out vec3 fragColor;
+
+void main ()
+{
+    // Rotate about the mesh origin, then move to the instance position
+    float c = cos(instanceTransform.z);
+    float s = sin(instanceTransform.z);
+    vec2 p = vec2(c * vertexPosition.x - s * vertexPosition.y,
+                  s * vertexPosition.x + c * vertexPosition.y);
+    vec4 v = vec4(p + instanceTransform.xy, vertexPosition.z, 1);
+
+    fragColor = instanceColor;
+
+    // Output position of the vertex, in clip space : VP * position
+    gl_Position = VP * v;
+}
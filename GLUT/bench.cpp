@@ -0,0 +1,138 @@
+/* Micro-benchmarks for the simulation kernels in simulation.h.
+   Build and run with: make bench
+
+   Every kernel runs at 1e2..1e6 entities, repeated until it has run for
+   at least MIN_SECONDS, and reports the time per entity and the heap
+   allocations per run. Stores are rebuilt from a fixed seed before each
+   run, outside the timed region, so runs are repeatable. */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <new>
+
+#include "simulation.h"
+
+/* Count every heap allocation made through operator new */
+static long long allocations = 0;
+
+void* operator new (size_t size)
+{
+    allocations++;
+    void* p = malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+void operator delete (void* p) noexcept { free(p); }
+void operator delete (void* p, size_t) noexcept { free(p); }
+
+const double MIN_SECONDS = 0.2;
+const int MIN_RUNS = 3;
+
+struct Result {
+    double ns_per_entity;
+    double allocs_per_run;
+};
+
+/* Runs setup() untimed then kernel() timed until enough time has passed */
+template <class Setup, class Kernel>
+Result measure (size_t n, Setup setup, Kernel kernel)
+{
+    double elapsed = 0;
+    long long allocs = 0;
+    int runs = 0;
+    while (runs < MIN_RUNS || elapsed < MIN_SECONDS) {
+        setup();
+        long long before = allocations;
+        auto start = std::chrono::steady_clock::now();
+        kernel();
+        elapsed += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        allocs += allocations - before;
+        runs++;
+    }
+    Result r = { elapsed * 1e9 / ((double) runs * n), (double) allocs / runs };
+    return r;
+}
+
+/* Uniform float in [lo, hi) */
+float uniform (Rng& rng, float lo, float hi)
+{
+    return lo + (hi - lo) * (rng.next() / 4294967296.0f);
+}
+
+/* n bullets scattered over the field with random headings */
+void scatterBullets (BulletStore& bullets, size_t n, Rng& rng)
+{
+    bullets.clear();
+    for (size_t i = 0; i < n; i++) {
+        float x = uniform(rng, -4, 4), y = uniform(rng, -3, 4);
+        bullets.add(x, y, uniform(rng, -180, 180));
+    }
+}
+
+/* n bricks scattered over the field */
+void scatterBricks (BrickStore& bricks, size_t n, Rng& rng)
+{
+    bricks.clear();
+    for (size_t i = 0; i < n; i++)
+        bricks.add(uniform(rng, -4, 4), uniform(rng, -3, 4), rng.below(3));
+}
+
+void report (const char* kernel, size_t n, const Result& r)
+{
+    printf("%-16s %10zu %12.2f %14.1f\n", kernel, n, r.ns_per_entity, r.allocs_per_run);
+}
+
+int main (int argc, char** argv)
+{
+    size_t max_n = 1000000;
+    for (int i = 1; i < argc; i++)
+        if (strcmp(argv[i], "--max") == 0 && i + 1 < argc)
+            max_n = strtoull(argv[++i], NULL, 10);
+
+    Level board;                       // the built-in three-mirror board
+    Level open;                        // no mirrors, integration alone
+    open.mirrors.clear();
+    Level always = board;              // every roll spawns a brick
+    always.weights[SPAWN_NONE] = 0;
+
+    BrickStore bricks;
+    BulletStore bullets(max_n);        // a pool big enough for the largest run
+    BulletIntegrator integrator;
+    Rng rng;
+    const char* kernels[] = { "scalar", "sse", "avx2" };
+
+    printf("%-16s %10s %12s %14s\n", "kernel", "entities", "ns/entity", "allocs/run");
+    for (size_t n = 100; n <= max_n; n *= 10) {
+        // spawning into an empty store, growth included
+        report("spawn", n, measure(n,
+            [&] { bricks.clear(); rng.seed(1); },
+            [&] { for (size_t i = 0; i < n; i++) spawnBrick(bricks, always, rng); }));
+
+        // one tick of movement, with every bullet kernel this CPU runs
+        for (int k = 0; k < 3; k++) {
+            if (!integrator.kernel.select(kernels[k]))
+                continue;
+            char name[32];
+            // with no mirrors on the board
+            snprintf(name, sizeof(name), "integrate/%s", kernels[k]);
+            report(name, n, measure(n,
+                [&] { rng.seed(2); scatterBullets(bullets, n, rng); },
+                [&] { integrator.run(bullets, open.mirrors, 0.1f); }));
+            // swept against the three mirrors
+            snprintf(name, sizeof(name), "mirrors/%s", kernels[k]);
+            report(name, n, measure(n,
+                [&] { rng.seed(3); scatterBullets(bullets, n, rng); },
+                [&] { integrator.run(bullets, board.mirrors, 0.1f); }));
+        }
+        integrator.kernel.select(NULL);
+
+        // n bullets against n bricks through the grid broadphase
+        report("collide", n, measure(n,
+            [&] { rng.seed(4); scatterBullets(bullets, n, rng); scatterBricks(bricks, n, rng); },
+            [&] { shootBricks(bullets, bricks); }));
+    }
+    return 0;
+}
@@ -0,0 +1,193 @@
+#ifndef BULLET_KERNELS_H
+#define BULLET_KERNELS_H
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <cstddef>
+
+#include "mirror.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BULLET_KERNELS_X86 1
+#endif
+
+/* Per-bullet result flags of moveBullets() */
+enum BulletFlag {
+    BULLET_CULL = 1,            // was off screen before the move, to be retired
+    BULLET_NEAR_MIRROR = 2      // may touch a mirror this step, needs the exact sweep
+};
+
+/* Mirrors as packed columns, with the distance within which a bullet has
+   to start to possibly reach each one this step */
+struct MirrorColumns {
+    std::vector<float> x, y, ux, uy, nx, ny, reach_along, reach_across;
+
+    void build (const std::vector<Mirror>& mirrors, float step, float radius)
+    {
+        size_t n = mirrors.size();
+        x.resize(n); y.resize(n); ux.resize(n); uy.resize(n);
+        nx.resize(n); ny.resize(n); reach_along.resize(n); reach_across.resize(n);
+        // generous slack, the flag only has to be a superset of real hits
+        float slack = 1e-3f + 1e-3f * step;
+        for (size_t m = 0; m < n; m++) {
+            x[m] = mirrors[m].x;
+            y[m] = mirrors[m].y;
+            ux[m] = mirrors[m].ux;
+            uy[m] = mirrors[m].uy;
+            nx[m] = mirrors[m].nx;
+            ny[m] = mirrors[m].ny;
+            reach_across[m] = step + slack;
+            reach_along[m] = mirrors[m].half + radius + step + slack;
+        }
+    }
+};
+
+/* The kernel: for bullets [0, n), save x,y into px,py, move them 'step'
+   along vx,vy, and write a BulletFlag set to flags. All versions do the
+   same float operations in the same order, so their results are
+   bit-identical and a replay does not depend on the CPU it runs on. */
+typedef void (*MoveBulletsFn) (float* x, float* y, float* px, float* py, const float* vx, const float* vy,
+                               unsigned char* flags, size_t n, float step, const MirrorColumns& mirrors);
+
+inline unsigned char bulletFlags (float x0, float y0, const MirrorColumns& m)
+{
+    unsigned char f = (y0 <= 4 && y0 >= -3 && x0 <= 4 && x0 >= -4) ? 0 : BULLET_CULL;
+    for (size_t k = 0; k < m.x.size(); k++) {
+        float dx = x0 - m.x[k], dy = y0 - m.y[k];
+        if (fabsf(dx * m.nx[k] + dy * m.ny[k]) <= m.reach_across[k] &&
+            fabsf(dx * m.ux[k] + dy * m.uy[k]) <= m.reach_along[k])
+            f |= BULLET_NEAR_MIRROR;
+    }
+    return f;
+}
+
+inline void moveBulletsScalar (float* x, float* y, float* px, float* py, const float* vx, const float* vy,
+                               unsigned char* flags, size_t n, float step, const MirrorColumns& mirrors)
+{
+    for (size_t i = 0; i < n; i++) {
+        float x0 = x[i], y0 = y[i];
+        px[i] = x0;
+        py[i] = y0;
+        x[i] = x0 + vx[i] * step;
+        y[i] = y0 + vy[i] * step;
+        flags[i] = bulletFlags(x0, y0, mirrors);
+    }
+}
+
+#ifdef BULLET_KERNELS_X86
+
+/* Spread the low 'lanes' bits of two movemasks into per-bullet flag bytes */
+inline void storeFlags (unsigned char* flags, int lanes, int in_bounds, int near)
+{
+    for (int k = 0; k < lanes; k++)
+        flags[k] = (((in_bounds >> k) & 1) ? 0 : BULLET_CULL) | (((near >> k) & 1) ? BULLET_NEAR_MIRROR : 0);
+}
+
+inline void moveBulletsSse (float* x, float* y, float* px, float* py, const float* vx, const float* vy,
+                            unsigned char* flags, size_t n, float step, const MirrorColumns& mirrors)
+{
+    const __m128 s = _mm_set1_ps(step);
+    const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    const __m128 lo_x = _mm_set1_ps(-4), hi_x = _mm_set1_ps(4), lo_y = _mm_set1_ps(-3), hi_y = _mm_set1_ps(4);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 x0 = _mm_loadu_ps(x + i), y0 = _mm_loadu_ps(y + i);
+        _mm_storeu_ps(px + i, x0);
+        _mm_storeu_ps(py + i, y0);
+        _mm_storeu_ps(x + i, _mm_add_ps(x0, _mm_mul_ps(_mm_loadu_ps(vx + i), s)));
+        _mm_storeu_ps(y + i, _mm_add_ps(y0, _mm_mul_ps(_mm_loadu_ps(vy + i), s)));
+        __m128 in = _mm_and_ps(_mm_and_ps(_mm_cmple_ps(y0, hi_y), _mm_cmpge_ps(y0, lo_y)),
+                               _mm_and_ps(_mm_cmple_ps(x0, hi_x), _mm_cmpge_ps(x0, lo_x)));
+        __m128 near = _mm_setzero_ps();
+        for (size_t k = 0; k < mirrors.x.size(); k++) {
+            __m128 dx = _mm_sub_ps(x0, _mm_set1_ps(mirrors.x[k]));
+            __m128 dy = _mm_sub_ps(y0, _mm_set1_ps(mirrors.y[k]));
+            __m128 across = _mm_add_ps(_mm_mul_ps(dx, _mm_set1_ps(mirrors.nx[k])), _mm_mul_ps(dy, _mm_set1_ps(mirrors.ny[k])));
+            __m128 along = _mm_add_ps(_mm_mul_ps(dx, _mm_set1_ps(mirrors.ux[k])), _mm_mul_ps(dy, _mm_set1_ps(mirrors.uy[k])));
+            near = _mm_or_ps(near, _mm_and_ps(_mm_cmple_ps(_mm_and_ps(across, abs_mask), _mm_set1_ps(mirrors.reach_across[k])),
+                                              _mm_cmple_ps(_mm_and_ps(along, abs_mask), _mm_set1_ps(mirrors.reach_along[k]))));
+        }
+        storeFlags(flags + i, 4, _mm_movemask_ps(in), _mm_movemask_ps(near));
+    }
+    moveBulletsScalar(x + i, y + i, px + i, py + i, vx + i, vy + i, flags + i, n - i, step, mirrors);
+}
+
+__attribute__((target("avx2")))
+inline void moveBulletsAvx2 (float* x, float* y, float* px, float* py, const float* vx, const float* vy,
+                             unsigned char* flags, size_t n, float step, const MirrorColumns& mirrors)
+{
+    const __m256 s = _mm256_set1_ps(step);
+    const __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+    const __m256 lo_x = _mm256_set1_ps(-4), hi_x = _mm256_set1_ps(4), lo_y = _mm256_set1_ps(-3), hi_y = _mm256_set1_ps(4);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 x0 = _mm256_loadu_ps(x + i), y0 = _mm256_loadu_ps(y + i);
+        _mm256_storeu_ps(px + i, x0);
+        _mm256_storeu_ps(py + i, y0);
+        _mm256_storeu_ps(x + i, _mm256_add_ps(x0, _mm256_mul_ps(_mm256_loadu_ps(vx + i), s)));
+        _mm256_storeu_ps(y + i, _mm256_add_ps(y0, _mm256_mul_ps(_mm256_loadu_ps(vy + i), s)));
+        __m256 in = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(y0, hi_y, _CMP_LE_OQ), _mm256_cmp_ps(y0, lo_y, _CMP_GE_OQ)),
+                                  _mm256_and_ps(_mm256_cmp_ps(x0, hi_x, _CMP_LE_OQ), _mm256_cmp_ps(x0, lo_x, _CMP_GE_OQ)));
+        __m256 near = _mm256_setzero_ps();
+        for (size_t k = 0; k < mirrors.x.size(); k++) {
+            __m256 dx = _mm256_sub_ps(x0, _mm256_set1_ps(mirrors.x[k]));
+            __m256 dy = _mm256_sub_ps(y0, _mm256_set1_ps(mirrors.y[k]));
+            __m256 across = _mm256_add_ps(_mm256_mul_ps(dx, _mm256_set1_ps(mirrors.nx[k])), _mm256_mul_ps(dy, _mm256_set1_ps(mirrors.ny[k])));
+            __m256 along = _mm256_add_ps(_mm256_mul_ps(dx, _mm256_set1_ps(mirrors.ux[k])), _mm256_mul_ps(dy, _mm256_set1_ps(mirrors.uy[k])));
+            near = _mm256_or_ps(near, _mm256_and_ps(
+                _mm256_cmp_ps(_mm256_and_ps(across, abs_mask), _mm256_set1_ps(mirrors.reach_across[k]), _CMP_LE_OQ),
+                _mm256_cmp_ps(_mm256_and_ps(along, abs_mask), _mm256_set1_ps(mirrors.reach_along[k]), _CMP_LE_OQ)));
+        }
+        storeFlags(flags + i, 8, _mm256_movemask_ps(in), _mm256_movemask_ps(near));
+    }
+    moveBulletsScalar(x + i, y + i, px + i, py + i, vx + i, vy + i, flags + i, n - i, step, mirrors);
+}
+
+#endif
+
+/* Picks the widest kernel this CPU runs; BULLET_KERNEL=scalar, sse or
+   avx2 in the environment asks for a particular one (for benchmarking) */
+struct BulletKernel {
+    MoveBulletsFn move;
+    const char* name;
+
+    BulletKernel () { select(getenv("BULLET_KERNEL")); }
+
+    /* NULL for the widest available. Returns false, keeping the widest,
+       if the one asked for is unknown or cannot run here. */
+    bool select (const char* want)
+    {
+        struct { const char* name; MoveBulletsFn move; bool runs; } kernels[3] = {
+            { "scalar", moveBulletsScalar, true },
+#ifdef BULLET_KERNELS_X86
+            { "sse", moveBulletsSse, false },
+            { "avx2", moveBulletsAvx2, false },
+#endif
+        };
+        int count = 1;
+#ifdef BULLET_KERNELS_X86
+        __builtin_cpu_init();   // may run before main, from a global's constructor
+        kernels[1].runs = __builtin_cpu_supports("sse2");
+        kernels[2].runs = __builtin_cpu_supports("avx2");
+        count = 3;
+#endif
+        int pick = 0;
+        for (int k = 0; k < count; k++)
+            if (kernels[k].runs)
+                pick = k;
+        bool found = !want;
+        for (int k = 0; want && k < count; k++)
+            if (kernels[k].runs && strcmp(want, kernels[k].name) == 0) {
+                pick = k;
+                found = true;
+            }
+        move = kernels[pick].move;
+        name = kernels[pick].name;
+        return found;
+    }
+};
+
+#endif
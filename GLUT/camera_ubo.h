@@ -0,0 +1,63 @@
+#ifndef CAMERA_UBO_H
+#define CAMERA_UBO_H
+
+#include <GL/glew.h>
+
+/* The view-projection matrix in a uniform buffer that every program
+   reads as
+
+       layout (std140) uniform Camera { mat4 VP; };
+
+   It is uploaded only when the camera moves, instead of being folded
+   into a fresh MVP for every object every frame. */
+struct CameraBuffer {
+    enum { BINDING = 0 };       // uniform buffer binding point
+
+    GLuint buffer;
+    float zoom, x, y;           // camera the buffer holds
+    bool valid;
+    long long uploads;
+
+    CameraBuffer () : buffer(0), zoom(0), x(0), y(0), valid(false), uploads(0) {}
+
+    /* Needs a current GL context */
+    void init ()
+    {
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferData(GL_UNIFORM_BUFFER, 16 * sizeof(GLfloat), NULL, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferBase(GL_UNIFORM_BUFFER, BINDING, buffer);
+    }
+
+    /* Point a program's Camera block at the buffer; false if it has none */
+    bool attach (GLuint program)
+    {
+        GLuint block = glGetUniformBlockIndex(program, "Camera");
+        if (block == GL_INVALID_INDEX)
+            return false;
+        glUniformBlockBinding(program, block, BINDING);
+        return true;
+    }
+
+    /* Whether the buffer is out of date for this zoom and pan */
+    bool changed (float z, float cx, float cy) const
+    {
+        return !valid || z != zoom || cx != x || cy != y;
+    }
+
+    /* Store the view-projection (16 floats, column-major) for that camera */
+    void upload (float z, float cx, float cy, const GLfloat* vp)
+    {
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, 16 * sizeof(GLfloat), vp);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        zoom = z;
+        x = cx;
+        y = cy;
+        valid = true;
+        uploads++;
+    }
+};
+
+#endif
@@ -0,0 +1,117 @@
+#ifndef ENTITY_STORE_H
+#define ENTITY_STORE_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/* Reference to an entity that survives other entities being removed.
+   Goes stale (lookup returns -1) once its own entity is removed. A full
+   fixed-capacity store hands out one that is not valid(). */
+struct EntityHandle {
+    uint32_t slot;
+    uint32_t generation;
+
+    bool valid () const { return slot != 0xffffffffu; }
+};
+
+/* Handle bookkeeping for a densely packed structure-of-arrays store.
+   Live entities sit at dense indices 0..size()-1. Removing one moves the
+   last entity into the hole; the owner swaps its columns the same way.
+   Freed slots are chained through their own dense_of entries, last freed
+   first, so reusing one is O(1) and needs no storage of its own. */
+struct EntityIndex {
+    enum : uint32_t { NO_SLOT = 0xffffffffu };
+
+    std::vector<uint32_t> slot_of;     // dense index -> slot
+    std::vector<uint32_t> dense_of;    // slot -> dense index, or the next free slot while free
+    std::vector<uint32_t> generation;  // slot -> generation of its current entity
+    uint32_t free_head;                // most recently freed slot, NO_SLOT if none
+
+    EntityIndex () : free_head(NO_SLOT) {}
+
+    size_t size () const { return slot_of.size(); }
+
+    /* Room for n entities without reallocating */
+    void reserve (size_t n)
+    {
+        slot_of.reserve(n);
+        dense_of.reserve(n);
+        generation.reserve(n);
+    }
+
+    /* New entity at dense index size()-1 */
+    EntityHandle add ()
+    {
+        uint32_t slot;
+        if (free_head != NO_SLOT) {
+            slot = free_head;
+            free_head = dense_of[slot];
+        }
+        else {
+            slot = (uint32_t) dense_of.size();
+            dense_of.push_back(0);
+            generation.push_back(0);
+        }
+        dense_of[slot] = (uint32_t) slot_of.size();
+        slot_of.push_back(slot);
+        EntityHandle h = { slot, generation[slot] };
+        return h;
+    }
+
+    EntityHandle handle (size_t i) const
+    {
+        EntityHandle h = { slot_of[i], generation[slot_of[i]] };
+        return h;
+    }
+
+    /* Dense index of the entity, or -1 if it has been removed */
+    long lookup (EntityHandle h) const
+    {
+        if (h.slot >= generation.size() || generation[h.slot] != h.generation)
+            return -1;
+        return dense_of[h.slot];
+    }
+
+    /* Remove dense index i by moving the last entity into it */
+    void remove (size_t i)
+    {
+        uint32_t slot = slot_of[i];
+        uint32_t last = slot_of.back();
+        slot_of[i] = last;
+        dense_of[last] = (uint32_t) i;
+        slot_of.pop_back();
+        generation[slot]++;
+        dense_of[slot] = free_head;
+        free_head = slot;
+    }
+
+    /* Remove everything; outstanding handles all go stale */
+    void clear ()
+    {
+        for (size_t i = 0; i < slot_of.size(); i++) {
+            generation[slot_of[i]]++;
+            dense_of[slot_of[i]] = free_head;
+            free_head = slot_of[i];
+        }
+        slot_of.clear();
+    }
+};
+
+/* Swap-and-pop one column of a store, matching EntityIndex::remove */
+template <typename T>
+inline void swapPop (std::vector<T>& column, size_t i)
+{
+    column[i] = column.back();
+    column.pop_back();
+}
+
+/* The same for a fixed-size column holding 'count' live entries; the
+   caller drops its count afterwards */
+template <typename T>
+inline void swapRemove (std::vector<T>& column, size_t i, size_t count)
+{
+    column[i] = column[count - 1];
+}
+
+#endif
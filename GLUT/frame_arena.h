@@ -0,0 +1,135 @@
+#ifndef FRAME_ARENA_H
+#define FRAME_ARENA_H
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstddef>
+#include <new>
+#include <vector>
+
+/* Bump-pointer allocator for temporaries that die within a frame. alloc()
+   moves a pointer through one block reserved up front; reset() at the start
+   of the next frame takes it all back at once. A frame that outgrows the
+   block spills into heap blocks, freed on reset and counted so the block
+   can be sized from the high-water mark.
+
+   Each thread binds its own arena with bind(); FrameVector and anything
+   else built on ArenaAllocator then draws from the calling thread's arena,
+   or from the heap on a thread that has none. Nothing allocated this way
+   may outlive the next reset(). */
+struct FrameArena {
+    const char* name;
+    char* base;
+    size_t capacity;
+    size_t used;                // only grows until the next reset
+    size_t spill_bytes;         // spilled this frame
+    long long frame_spills;     // heap blocks this frame
+    size_t high_water;          // most any finished frame has needed
+    void* spills;               // heap blocks, chained through their first word
+    long long spilled, resets;  // over finished frames
+    bool debug;                 // poison memory on reset to catch stale pointers
+
+    FrameArena (const char* arena_name, size_t bytes)
+        : name(arena_name), base(NULL), capacity(bytes), used(0), spill_bytes(0), frame_spills(0),
+          high_water(0), spills(NULL), spilled(0), resets(0), debug(false) {}
+
+    ~FrameArena ()
+    {
+        reset();
+        free(base);
+    }
+
+    static FrameArena*& current ()
+    {
+        static thread_local FrameArena* arena = NULL;
+        return arena;
+    }
+
+    /* Make this the calling thread's arena; reserves the block on first use */
+    void bind ()
+    {
+        if (!base)
+            base = (char*) malloc(capacity);
+        current() = this;
+    }
+
+    void* alloc (size_t bytes, size_t align = alignof(std::max_align_t))
+    {
+        size_t start = (used + align - 1) & ~(align - 1);
+        if (start + bytes <= capacity) {
+            used = start + bytes;
+            return base + start;
+        }
+        // out of room - one heap block, handed back at reset
+        size_t header = (sizeof(void*) + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+        char* block = (char*) malloc(header + bytes);
+        if (!block)
+            throw std::bad_alloc();
+        *(void**) block = spills;
+        spills = block;
+        frame_spills++;
+        spill_bytes += bytes;
+        return block + header;
+    }
+
+    /* Start of a frame - everything handed out since the last reset is gone */
+    void reset ()
+    {
+        while (spills) {
+            void* next = *(void**) spills;
+            free(spills);
+            spills = next;
+        }
+        if (debug && base)
+            memset(base, 0xdd, used);
+        if (used + spill_bytes > high_water)
+            high_water = used + spill_bytes;
+        spilled += frame_spills;
+        used = spill_bytes = 0;
+        frame_spills = 0;
+        resets++;
+    }
+
+    /* Counts frames up to the last reset(); whatever was allocated since is
+       not a full frame and is left out */
+    void report (FILE* out) const
+    {
+        fprintf(out, "arena %s: high water %.1f KB of %.1f KB over %lld frames, %lld spills to the heap\n",
+                name, high_water / 1024.0, capacity / 1024.0, resets, spilled);
+    }
+};
+
+/* Standard allocator over the calling thread's frame arena. Freeing is a
+   no-op for arena memory; reset() reclaims it. */
+template <class T>
+struct ArenaAllocator {
+    typedef T value_type;
+
+    FrameArena* arena;
+
+    ArenaAllocator () : arena(FrameArena::current()) {}
+    template <class U> ArenaAllocator (const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+    T* allocate (size_t n)
+    {
+        if (arena)
+            return (T*) arena->alloc(n * sizeof(T), alignof(T));
+        return (T*) ::operator new(n * sizeof(T));
+    }
+
+    void deallocate (T* p, size_t)
+    {
+        if (!arena)
+            ::operator delete(p);
+    }
+
+    template <class U> bool operator== (const ArenaAllocator<U>& other) const { return arena == other.arena; }
+    template <class U> bool operator!= (const ArenaAllocator<U>& other) const { return arena != other.arena; }
+};
+
+/* A vector for per-frame scratch data */
+template <class T>
+using FrameVector = std::vector<T, ArenaAllocator<T> >;
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <cstdio>
+#include <GL/glew.h>
+
+/* Shadow copy of the bits of GL state the game touches every draw.
+   Calls that would set a value that is already current are skipped and
+   counted. All binds must go through here, or call invalidate() after
+   code that changes this state behind the cache's back. */
+struct GLStateCache {
+    GLuint program;
+    GLuint vertex_array;
+    GLuint array_buffer;
+    GLenum polygon_mode;
+    bool program_known, vertex_array_known, array_buffer_known, polygon_mode_known;
+
+    long long issued, elided;               // this frame
+    long long last_issued, last_elided;     // previous complete frame
+    long long total_issued, total_elided;
+    long long frames;
+
+    GLStateCache () : issued(0), elided(0), last_issued(0), last_elided(0),
+                      total_issued(0), total_elided(0), frames(0)
+    {
+        invalidate();
+    }
+
+    void invalidate ()
+    {
+        program_known = vertex_array_known = array_buffer_known = polygon_mode_known = false;
+    }
+
+    /* Roll the per-frame counters over */
+    void beginFrame ()
+    {
+        last_issued = issued;
+        last_elided = elided;
+        total_issued += issued;
+        total_elided += elided;
+        issued = elided = 0;
+        frames++;
+    }
+
+    bool changed (bool& is_known, GLuint& current, GLuint value)
+    {
+        if (is_known && current == value) {
+            elided++;
+            return false;
+        }
+        is_known = true;
+        current = value;
+        issued++;
+        return true;
+    }
+
+    void useProgram (GLuint p)
+    {
+        if (changed(program_known, program, p))
+            glUseProgram(p);
+    }
+
+    void bindVertexArray (GLuint v)
+    {
+        if (changed(vertex_array_known, vertex_array, v))
+            glBindVertexArray(v);
+    }
+
+    void bindArrayBuffer (GLuint b)
+    {
+        if (changed(array_buffer_known, array_buffer, b))
+            glBindBuffer(GL_ARRAY_BUFFER, b);
+    }
+
+    void polygonMode (GLenum m)
+    {
+        if (changed(polygon_mode_known, polygon_mode, m))
+            glPolygonMode(GL_FRONT_AND_BACK, m);
+    }
+
+    void report (FILE* out) const
+    {
+        long long all = total_issued + total_elided;
+        fprintf(out, "gl state: %lld calls issued, %lld elided (%.1f%%), %.1f elided per frame\n",
+                total_issued, total_elided, all ? 100.0 * total_elided / all : 0.0,
+                frames ? (double) total_elided / frames : 0.0);
+    }
+};
+
+#endif
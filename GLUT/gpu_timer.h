@@ -0,0 +1,128 @@
+#ifndef GPU_TIMER_H
+#define GPU_TIMER_H
+
+#include <vector>
+#include <cstdio>
+#include <GL/glew.h>
+
+#include "profiler.h"
+
+/* Labeled render passes measured on the GPU */
+enum GpuPass {
+    GPU_MIRRORS,
+    GPU_SCORE,
+    GPU_BASKETS,
+    GPU_CANNON,
+    GPU_BULLETS,
+    GPU_BRICKS,
+    GPU_PASS_COUNT
+};
+
+static const char* const GPU_PASS_NAMES[GPU_PASS_COUNT] = {
+    "mirrors", "score", "baskets", "cannon", "bullets", "bricks"
+};
+
+/* GL_TIME_ELAPSED queries around each pass. Query objects are double
+   buffered: a frame writes one set while the set from two frames back is
+   read, and only if the driver says the result is available, so reading
+   never stalls the pipeline. Passes must not nest (a GL restriction). */
+struct GpuTimer {
+    enum { FRAMES = 2, RING_SIZE = 4096 };
+
+    bool enabled;
+    long long frame;
+    GLuint queries[FRAMES][GPU_PASS_COUNT];
+    bool issued[FRAMES][GPU_PASS_COUNT];
+    std::vector<double> samples[GPU_PASS_COUNT];   // microseconds, ring buffers
+    long long recorded[GPU_PASS_COUNT];
+    long long dropped;                             // results not ready in time
+
+    GpuTimer () : enabled(false), frame(0), dropped(0)
+    {
+        for (int p = 0; p < GPU_PASS_COUNT; p++) {
+            samples[p].resize(RING_SIZE);
+            recorded[p] = 0;
+        }
+    }
+
+    /* Needs a current GL context */
+    void init ()
+    {
+        if (!enabled)
+            return;
+        if (!GLEW_VERSION_3_3 && !GLEW_ARB_timer_query) {
+            fprintf(stderr, "gpu: timer queries not supported, GPU timing disabled\n");
+            enabled = false;
+            return;
+        }
+        glGenQueries(FRAMES * GPU_PASS_COUNT, &queries[0][0]);
+        for (int f = 0; f < FRAMES; f++)
+            for (int p = 0; p < GPU_PASS_COUNT; p++)
+                issued[f][p] = false;
+    }
+
+    /* Collect the results of the set this frame is about to reuse */
+    void beginFrame ()
+    {
+        if (!enabled)
+            return;
+        frame++;
+        int set = frame % FRAMES;
+        for (int p = 0; p < GPU_PASS_COUNT; p++) {
+            if (!issued[set][p])
+                continue;
+            issued[set][p] = false;
+            GLint available = 0;
+            glGetQueryObjectiv(queries[set][p], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) {
+                dropped++;
+                continue;
+            }
+            GLuint64 ns = 0;
+            glGetQueryObjectui64v(queries[set][p], GL_QUERY_RESULT, &ns);
+            samples[p][recorded[p]++ % RING_SIZE] = ns / 1000.0;
+        }
+    }
+
+    void begin (int pass)
+    {
+        if (!enabled)
+            return;
+        int set = frame % FRAMES;
+        glBeginQuery(GL_TIME_ELAPSED, queries[set][pass]);
+        issued[set][pass] = true;
+    }
+
+    void end ()
+    {
+        if (enabled)
+            glEndQuery(GL_TIME_ELAPSED);
+    }
+
+    double percentile (int pass, double pct) const
+    {
+        return ringPercentile(samples[pass], recorded[pass], pct);
+    }
+
+    void report (FILE* out) const
+    {
+        fprintf(out, "%-10s %10s %10s %10s %10s %10s\n", "gpu(us)", "samples", "p50", "p90", "p99", "max");
+        for (int p = 0; p < GPU_PASS_COUNT; p++) {
+            if (recorded[p] == 0)
+                continue;
+            fprintf(out, "%-10s %10lld %10.1f %10.1f %10.1f %10.1f\n", GPU_PASS_NAMES[p], recorded[p],
+                    percentile(p, 50), percentile(p, 90), percentile(p, 99), percentile(p, 100));
+        }
+        if (dropped)
+            fprintf(out, "gpu: %lld results were not ready in time and were skipped\n", dropped);
+    }
+};
+
+/* Times the enclosing scope as one GPU pass */
+struct GpuScope {
+    GpuTimer& timer;
+    GpuScope (GpuTimer& t, int pass) : timer(t) { timer.begin(pass); }
+    ~GpuScope () { timer.end(); }
+};
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef INPUT_QUEUE_H
+#define INPUT_QUEUE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+
+#include "replay.h"
+
+/* Bounded single-producer / single-consumer ring. push() must only ever be
+   called from one thread and pop() from one thread, which may be another;
+   neither blocks nor takes a lock. The two indices sit on their own cache
+   lines so producer and consumer do not fight over one. */
+template <class T, size_t N>
+struct SpscRing {
+    static_assert((N & (N - 1)) == 0, "capacity must be a power of two");
+
+    alignas(64) std::atomic<size_t> head;   // next slot to read, advanced by the consumer
+    alignas(64) std::atomic<size_t> tail;   // next slot to write, advanced by the producer
+    alignas(64) T slots[N];
+
+    SpscRing () : head(0), tail(0) {}
+
+    /* Producer side; false if the ring is full and 'item' was not queued */
+    bool push (const T& item)
+    {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == N)
+            return false;
+        slots[t & (N - 1)] = item;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    /* Consumer side; false if there was nothing to take */
+    bool pop (T& item)
+    {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire))
+            return false;
+        item = slots[h & (N - 1)];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+/* An input as a window callback saw it, with the moment it arrived; the
+   event's tick is filled in when the simulation takes it */
+struct QueuedInput {
+    InputEvent event;
+    long long stamp_us;     // steady clock, microseconds
+};
+
+inline long long steadyMicros ()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#endif
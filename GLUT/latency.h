@@ -0,0 +1,141 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+#include "input_queue.h"
+#include "profiler.h"
+
+/* What an input turned out to do, decided when the tick applied it */
+enum LatencyKind {
+    LATENCY_FIRE,       // put a bullet on the board
+    LATENCY_OTHER,      // anything else: aiming, moving, zooming
+    LATENCY_KIND_COUNT
+};
+
+static const char* const LATENCY_KIND_NAMES[LATENCY_KIND_COUNT] = { "fire", "other" };
+
+/* An applied input on its way to the screen */
+struct AppliedInput {
+    long long tick;         // the tick that applied it; visible in snapshots after it
+    long long stamp_us;     // when its callback ran, steady clock
+    int kind;
+};
+
+/* Input-to-photon latency - from the window callback to the end of the
+   first buffer swap that shows the tick that applied the input. The
+   simulation reports inputs as it applies them, the renderer reports
+   each snapshot it has swapped; they may be different threads. Keeps a
+   histogram of every event for the report at exit and the last
+   RING_SIZE samples for the live overlay. */
+struct LatencyTracker {
+    enum { RING_SIZE = 256, BUCKETS = 200 };
+    static constexpr double BUCKET_US = 500;    // histogram resolution, 0..100 ms
+
+    bool enabled;
+    SpscRing<AppliedInput, 4096> in_flight;     // simulation -> renderer
+    AppliedInput held;                          // popped, but not on screen yet
+    bool holding;
+    long long dropped;
+    long long histogram[LATENCY_KIND_COUNT][BUCKETS + 1];   // last bucket is everything above
+    std::vector<double> recent[LATENCY_KIND_COUNT];         // microseconds, ring buffers
+    long long recorded[LATENCY_KIND_COUNT];
+    double worst[LATENCY_KIND_COUNT];
+
+    LatencyTracker () : enabled(false), holding(false), dropped(0)
+    {
+        for (int k = 0; k < LATENCY_KIND_COUNT; k++) {
+            for (int b = 0; b <= BUCKETS; b++)
+                histogram[k][b] = 0;
+            recent[k].resize(RING_SIZE);
+            recorded[k] = 0;
+            worst[k] = 0;
+        }
+    }
+
+    /* Simulation side - 'tick' has just applied an input stamped 'stamp_us' */
+    void applied (long long tick, long long stamp_us, int kind)
+    {
+        AppliedInput a = { tick, stamp_us, kind };
+        if (!in_flight.push(a))
+            dropped++;
+    }
+
+    /* Render side - a snapshot taken after 'ticks' ticks finished swapping at 'now_us' */
+    void presented (long long ticks, long long now_us)
+    {
+        while (holding || in_flight.pop(held)) {
+            if (held.tick >= ticks) {   // applied after this snapshot was taken
+                holding = true;
+                return;
+            }
+            holding = false;
+            record(held.kind, now_us - held.stamp_us);
+        }
+    }
+
+    void record (int kind, double latency_us)
+    {
+        int b = (int) (latency_us / BUCKET_US);
+        histogram[kind][b < BUCKETS ? b : BUCKETS]++;
+        recent[kind][recorded[kind]++ % RING_SIZE] = latency_us;
+        if (latency_us > worst[kind])
+            worst[kind] = latency_us;
+    }
+
+    /* Percentile (0..100) of the last RING_SIZE events of a kind */
+    double recentPercentile (int kind, double pct) const
+    {
+        return ringPercentile(recent[kind], recorded[kind], pct);
+    }
+
+    /* Percentile (0..100) of every event of a kind, to its bucket's upper edge */
+    double percentile (int kind, double pct) const
+    {
+        long long want = (long long) (pct / 100.0 * recorded[kind]);
+        long long seen = 0;
+        for (int b = 0; b < BUCKETS; b++) {
+            seen += histogram[kind][b];
+            if (seen > want)
+                return std::min((b + 1) * BUCKET_US, worst[kind]);
+        }
+        return worst[kind];
+    }
+
+    void report (FILE* out) const
+    {
+        fprintf(out, "%-10s %10s %10s %10s %10s %10s\n", "input(ms)", "events", "p50", "p90", "p99", "max");
+        for (int k = 0; k < LATENCY_KIND_COUNT; k++) {
+            if (recorded[k] == 0)
+                continue;
+            fprintf(out, "%-10s %10lld %10.1f %10.1f %10.1f %10.1f\n", LATENCY_KIND_NAMES[k], recorded[k],
+                    percentile(k, 50) / 1000, percentile(k, 90) / 1000, percentile(k, 99) / 1000, worst[k] / 1000);
+        }
+        for (int k = 0; k < LATENCY_KIND_COUNT; k++) {
+            if (recorded[k] == 0)
+                continue;
+            long long peak = 1;
+            for (int b = 0; b <= BUCKETS; b++)
+                if (histogram[k][b] > peak)
+                    peak = histogram[k][b];
+            fprintf(out, "%s latency histogram:\n", LATENCY_KIND_NAMES[k]);
+            for (int b = 0; b <= BUCKETS; b++) {
+                if (histogram[k][b] == 0)
+                    continue;
+                if (b < BUCKETS)
+                    fprintf(out, "  %5.1f-%5.1f ms %8lld ", b * BUCKET_US / 1000, (b + 1) * BUCKET_US / 1000, histogram[k][b]);
+                else
+                    fprintf(out, "  %5.1f+      ms %8lld ", b * BUCKET_US / 1000, histogram[k][b]);
+                for (long long bar = 0; bar < histogram[k][b] * 50 / peak; bar++)
+                    fputc('#', out);
+                fputc('\n', out);
+            }
+        }
+        if (dropped)
+            fprintf(out, "latency: %lld inputs were not tracked, the renderer fell behind\n", dropped);
+    }
+};
+
+#endif
@@ -0,0 +1,317 @@
+#ifndef LEVEL_H
+#define LEVEL_H
+
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "mirror.h"
+#include "replay.h"
+
+/* What a spawn roll can produce */
+enum SpawnKind {
+    SPAWN_NONE,
+    SPAWN_RED,
+    SPAWN_BLACK,
+    SPAWN_GREEN,
+    SPAWN_KINDS
+};
+
+static const char* const SPAWN_NAMES[SPAWN_KINDS] = { "none", "red", "black", "green" };
+
+/* Board layout: mirrors, basket widths, the lanes bricks fall in and the
+   relative odds of each kind of brick per spawn. The defaults are the
+   original hand-placed board. */
+struct Level {
+    enum { MAX_MIRRORS = 1 << 16, MAX_LANES = 1 << 10 };
+
+    std::vector<Mirror> mirrors;
+    float basket_width[2];              // red (left) and green (right)
+    std::vector<float> lanes;           // x of each spawn lane
+    uint32_t weights[SPAWN_KINDS];
+
+    Level ()
+    {
+        mirrors.push_back(Mirror(3, 0, 90));
+        mirrors.push_back(Mirror(2, 3, 120));
+        mirrors.push_back(Mirror(1, -2, 60));
+        basket_width[0] = basket_width[1] = 2;
+        for (int x = -3; x <= 2; x++)
+            lanes.push_back(x);
+        weights[SPAWN_NONE] = 2;
+        weights[SPAWN_RED] = weights[SPAWN_BLACK] = weights[SPAWN_GREEN] = 1;
+    }
+
+    uint32_t totalWeight () const
+    {
+        uint32_t total = 0;
+        for (int k = 0; k < SPAWN_KINDS; k++)
+            total += weights[k];
+        return total;
+    }
+
+    int rollKind (Rng& rng) const
+    {
+        int roll = rng.below(totalWeight());
+        int k = 0;
+        while (roll >= (int) weights[k])
+            roll -= weights[k++];
+        return k;
+    }
+
+    float rollLane (Rng& rng) const { return lanes[rng.below(lanes.size())]; }
+
+    /* Empty on success. Written so that NaN fails every check: strtof
+       and the binary form both let it through. */
+    std::string validate () const
+    {
+        if (mirrors.size() > MAX_MIRRORS)
+            return "too many mirrors";
+        for (size_t i = 0; i < mirrors.size(); i++) {
+            const Mirror& m = mirrors[i];
+            if (!std::isfinite(m.x) || !std::isfinite(m.y) || !std::isfinite(m.angle) ||
+                !std::isfinite(m.half) || !(m.half > 0))
+                return "mirror positions and angles must be finite, half-lengths positive";
+        }
+        if (lanes.empty() || lanes.size() > MAX_LANES)
+            return "need between 1 and 1024 lanes";
+        for (size_t i = 0; i < lanes.size(); i++)
+            if (!std::isfinite(lanes[i]))
+                return "lanes must be finite";
+        for (int b = 0; b < 2; b++)
+            if (!(basket_width[b] > 0) || !std::isfinite(basket_width[b]))
+                return "basket widths must be positive and finite";
+        uint64_t total = 0;
+        for (int k = 0; k < SPAWN_KINDS; k++)
+            total += weights[k];
+        if (total == 0 || total > 0x7fffffff)
+            return "brick weights must add up to a positive number";
+        return "";
+    }
+};
+
+/* Text authoring form, one directive per line, '#' starts a comment:
+
+     basket 2 2            widths of the red and green baskets
+     lanes -3 -2 -1 0 1 2  x of each spawn lane
+     bricks 2 1 1 1        weights of none, red, black, green per spawn
+     mirror 3 0 90 [0.4]   x, y, angle in degrees, optional half-length
+
+   Directives not given keep their defaults, except that a file with any
+   'mirror' line replaces the default mirrors. Every number must be
+   finite - nan and inf parse but are refused - and basket widths and
+   half-lengths must be positive.
+
+   Binary form, what --compile-level writes, in host byte order:
+     header   "BBLV", u32 version, u32 mirror count, u32 lane count,
+              f32 basket widths[2], u32 weights[4]
+     mirrors  f32 x, y, angle, half-length each
+     lanes    f32 x each */
+struct LevelHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t mirror_count;
+    uint32_t lane_count;
+    float basket_width[2];
+    uint32_t weights[SPAWN_KINDS];
+};
+
+static const uint32_t LEVEL_VERSION = 1;
+
+inline bool parseLevelBinary (const char* data, size_t size, Level& out, std::string& error)
+{
+    LevelHeader h;
+    if (size < sizeof(h)) {
+        error = "truncated header";
+        return false;
+    }
+    memcpy(&h, data, sizeof(h));
+    if (h.version != LEVEL_VERSION) {
+        error = "unsupported version";
+        return false;
+    }
+    if (h.mirror_count > Level::MAX_MIRRORS || h.lane_count > Level::MAX_LANES ||
+        size != sizeof(h) + (4 * (size_t) h.mirror_count + h.lane_count) * sizeof(float)) {
+        error = "size does not match header";
+        return false;
+    }
+    Level level;
+    level.basket_width[0] = h.basket_width[0];
+    level.basket_width[1] = h.basket_width[1];
+    memcpy(level.weights, h.weights, sizeof(level.weights));
+    const char* p = data + sizeof(h);
+    level.mirrors.clear();
+    level.mirrors.reserve(h.mirror_count);
+    for (uint32_t i = 0; i < h.mirror_count; i++) {
+        float m[4];
+        memcpy(m, p, sizeof(m));
+        p += sizeof(m);
+        level.mirrors.push_back(Mirror(m[0], m[1], m[2], m[3]));
+    }
+    level.lanes.resize(h.lane_count);
+    if (h.lane_count)
+        memcpy(&level.lanes[0], p, h.lane_count * sizeof(float));
+    error = level.validate();
+    if (!error.empty())
+        return false;
+    out.mirrors.swap(level.mirrors);
+    out.lanes.swap(level.lanes);
+    memcpy(out.basket_width, level.basket_width, sizeof(out.basket_width));
+    memcpy(out.weights, level.weights, sizeof(out.weights));
+    return true;
+}
+
+inline bool parseLevelText (const char* data, size_t size, Level& out, std::string& error)
+{
+    Level level;
+    bool mirrors_given = false;
+    std::string line;
+    int number = 0;
+    const char* end = data + size;
+    while (data < end) {
+        const char* eol = (const char*) memchr(data, '\n', end - data);
+        if (!eol)
+            eol = end;
+        line.assign(data, eol);
+        data = eol + 1;
+        number++;
+        size_t hash = line.find('#');
+        if (hash != std::string::npos)
+            line.erase(hash);
+
+        // split the line into a directive and its numbers
+        char word[16] = "";
+        int used = 0;
+        if (sscanf(line.c_str(), " %15s%n", word, &used) != 1)
+            continue;
+        std::vector<float> args;
+        const char* s = line.c_str() + used;
+        for (;;) {
+            char* next;
+            float v = strtof(s, &next);
+            if (next == s)
+                break;
+            args.push_back(v);
+            s = next;
+        }
+        while (*s == ' ' || *s == '\t' || *s == '\r')
+            s++;
+        bool ok = *s == '\0';
+        std::string name = word;
+
+        if (ok && name == "mirror" && (args.size() == 3 || args.size() == 4)) {
+            if (!mirrors_given)
+                level.mirrors.clear();
+            mirrors_given = true;
+            level.mirrors.push_back(Mirror(args[0], args[1], args[2], args.size() == 4 ? args[3] : 0.4f));
+        }
+        else if (ok && name == "basket" && args.size() == 2) {
+            level.basket_width[0] = args[0];
+            level.basket_width[1] = args[1];
+        }
+        else if (ok && name == "lanes" && !args.empty())
+            level.lanes = args;
+        else if (ok && name == "bricks" && args.size() == SPAWN_KINDS) {
+            for (int k = 0; k < SPAWN_KINDS; k++) {
+                if (args[k] < 0 || args[k] > 1e9f || args[k] != floorf(args[k])) {
+                    ok = false;
+                    break;
+                }
+                level.weights[k] = (uint32_t) args[k];
+            }
+        }
+        else
+            ok = false;
+        if (!ok) {
+            char where[32];
+            snprintf(where, sizeof(where), "line %d: ", number);
+            error = std::string(where) + "cannot parse '" + line + "'";
+            return false;
+        }
+    }
+    error = level.validate();
+    if (!error.empty())
+        return false;
+    out = level;
+    return true;
+}
+
+/* Maps the file and parses whichever form it is in. On failure 'out' is
+   left untouched and 'error' says why. */
+inline bool loadLevel (const char* path, Level& out, std::string& error)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        error = "cannot open";
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        error = "empty file";
+        return false;
+    }
+    size_t size = st.st_size;
+    void* map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        error = "cannot map";
+        return false;
+    }
+    const char* data = (const char*) map;
+    bool ok = size >= 4 && memcmp(data, "BBLV", 4) == 0 ? parseLevelBinary(data, size, out, error)
+                                                        : parseLevelText(data, size, out, error);
+    munmap(map, size);
+    return ok;
+}
+
+/* Writes the binary form, through a temporary file so readers polling
+   for changes never see half a level */
+inline bool saveLevel (const char* path, const Level& level)
+{
+    LevelHeader h;
+    memcpy(h.magic, "BBLV", 4);
+    h.version = LEVEL_VERSION;
+    h.mirror_count = level.mirrors.size();
+    h.lane_count = level.lanes.size();
+    memcpy(h.basket_width, level.basket_width, sizeof(h.basket_width));
+    memcpy(h.weights, level.weights, sizeof(h.weights));
+
+    std::string tmp = std::string(path) + ".tmp";
+    FILE* f = fopen(tmp.c_str(), "wb");
+    if (!f)
+        return false;
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1;
+    for (size_t i = 0; ok && i < level.mirrors.size(); i++) {
+        const Mirror& m = level.mirrors[i];
+        float rec[4] = { m.x, m.y, m.angle, m.half };
+        ok = fwrite(rec, sizeof(rec), 1, f) == 1;
+    }
+    if (ok && !level.lanes.empty())
+        ok = fwrite(&level.lanes[0], sizeof(float), level.lanes.size(), f) == level.lanes.size();
+    ok = (fclose(f) == 0) && ok;
+    if (!ok || rename(tmp.c_str(), path) != 0) {
+        remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+/* Modification time of a file, 0 if it cannot be read; used for hot reload */
+inline long long fileStamp (const char* path)
+{
+    struct stat st;
+    if (stat(path, &st) != 0)
+        return 0;
+    return (long long) st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+}
+
+#endif
@@ -0,0 +1,105 @@
+#ifndef MIRROR_H
+#define MIRROR_H
+
+#include <cmath>
+#include <vector>
+
+/* A flat two-sided mirror: a segment of half-length 'half' centred at
+   (x, y), rotated 'angle' degrees from the x axis. The unit direction
+   along the mirror and its normal are kept alongside so the sweep does
+   no trigonometry. */
+struct Mirror {
+    float x, y, angle, half;
+    float ux, uy;       // along the mirror
+    float nx, ny;       // normal
+
+    Mirror (float cx, float cy, float degrees, float half_length = 0.4f)
+        : x(cx), y(cy), angle(degrees), half(half_length)
+    {
+        float a = degrees * (float) M_PI / 180.0f;
+        ux = cosf(a);
+        uy = sinf(a);
+        nx = -uy;
+        ny = ux;
+    }
+
+    /* Where the motion (x0,y0) -> (x0+dx,y0+dy) of a point of radius r
+       crosses the mirror line, as a fraction of the motion in [0,1], or -1
+       if it misses. Exact for any speed, so nothing tunnels through. */
+    float sweep (float x0, float y0, float dx, float dy, float r) const
+    {
+        float d0 = (x0 - x) * nx + (y0 - y) * ny;
+        float dn = dx * nx + dy * ny;
+        if (dn == 0)
+            return -1;
+        float t = -d0 / dn;
+        if (t < 0 || t > 1)
+            return -1;
+        float s = (x0 + dx * t - x) * ux + (y0 + dy * t - y) * uy;
+        if (fabsf(s) > half + r)
+            return -1;
+        return t;
+    }
+
+    /* Reflected heading in degrees: the same as mirroring the direction
+       vector d - 2(d.n)n, but stays exact for whole-degree angles */
+    float reflect (float heading) const
+    {
+        float out = 2 * angle - heading;
+        while (out > 180) out -= 360;
+        while (out <= -180) out += 360;
+        return out;
+    }
+};
+
+/* Unit vector of a heading in degrees; everything that turns headings
+   into directions goes through here so the results agree to the bit */
+inline void headingVector (float heading, float& vx, float& vy)
+{
+    float a = heading * (float) M_PI / 180.0f;
+    vx = cosf(a);
+    vy = sinf(a);
+}
+
+/* Moves a point of radius r by 'distance' along 'heading' (degrees),
+   bouncing off every mirror it meets on the way, up to max_bounces
+   times. 'last' is the mirror the point left most recently (-1 for none);
+   it is skipped, since a point cannot meet the same flat mirror twice in
+   a row, which also keeps a point resting on a mirror line from
+   reflecting again. Returns the number of bounces. */
+inline int sweepMirrors (const std::vector<Mirror>& mirrors, float& x, float& y, float& heading,
+                         int& last, float distance, float r, int max_bounces = 4)
+{
+    int bounces = 0;
+    while (distance > 0) {
+        float vx, vy;
+        headingVector(heading, vx, vy);
+        float dx = distance * vx, dy = distance * vy;
+        int hit = -1;
+        float first = 2;
+        if (bounces < max_bounces)
+            for (size_t m = 0; m < mirrors.size(); m++) {
+                if ((int) m == last)
+                    continue;
+                float t = mirrors[m].sweep(x, y, dx, dy, r);
+                if (t >= 0 && t < first) {
+                    first = t;
+                    hit = m;
+                }
+            }
+        if (hit < 0) {
+            x += dx;
+            y += dy;
+            break;
+        }
+        x += dx * first;
+        y += dy * first;
+        distance *= 1 - first;
+        heading = mirrors[hit].reflect(heading);
+        last = hit;
+        bounces++;
+    }
+    return bounces;
+}
+
+#endif
@@ -0,0 +1,151 @@
+#ifndef OFFSCREEN_H
+#define OFFSCREEN_H
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <GL/glew.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+/* A GL 3.3 core context with no window, from EGL, rendering into a
+   framebuffer object. Prefers Mesa's surfaceless platform, which needs
+   no display server at all, and falls back to the default display with
+   a 1x1 pbuffer. With Mesa's llvmpipe or softpipe drivers this runs on
+   machines with no GPU. */
+struct OffscreenContext {
+    EGLDisplay display;
+    EGLContext context;
+    EGLSurface surface;
+    GLuint framebuffer, color, depth;
+    int width, height;
+
+    OffscreenContext () : display(EGL_NO_DISPLAY), context(EGL_NO_CONTEXT), surface(EGL_NO_SURFACE),
+                          framebuffer(0), color(0), depth(0), width(0), height(0) {}
+
+    static bool hasExtension (const char* list, const char* name)
+    {
+        size_t n = strlen(name);
+        for (const char* p = list ? strstr(list, name) : NULL; p; p = strstr(p + n, name))
+            if ((p == list || p[-1] == ' ') && (p[n] == ' ' || p[n] == '\0'))
+                return true;
+        return false;
+    }
+
+    EGLDisplay openDisplay ()
+    {
+        const char* client = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+        if (hasExtension(client, "EGL_MESA_platform_surfaceless")) {
+            PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+                (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+            if (getPlatformDisplay) {
+                EGLDisplay d = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+                if (d != EGL_NO_DISPLAY && eglInitialize(d, NULL, NULL))
+                    return d;
+            }
+        }
+        EGLDisplay d = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        if (d != EGL_NO_DISPLAY && eglInitialize(d, NULL, NULL))
+            return d;
+        return EGL_NO_DISPLAY;
+    }
+
+    /* Creates the context, makes it current and binds a w x h framebuffer.
+       On failure 'error' says which step failed. GL entry points still need
+       loading (glewInit) after this succeeds and before init() is called. */
+    bool create (int w, int h, std::string& error)
+    {
+        display = openDisplay();
+        if (display == EGL_NO_DISPLAY) {
+            error = "no EGL display";
+            return false;
+        }
+        const EGLint config_attribs[] = {
+            EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+            EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8,
+            EGL_NONE
+        };
+        EGLConfig config;
+        EGLint configs = 0;
+        if (!eglChooseConfig(display, config_attribs, &config, 1, &configs) || configs == 0) {
+            error = "no EGL config for desktop GL";
+            return false;
+        }
+        if (!eglBindAPI(EGL_OPENGL_API)) {
+            error = "EGL cannot bind the desktop GL API";
+            return false;
+        }
+        const EGLint context_attribs[] = {
+            EGL_CONTEXT_MAJOR_VERSION, 3,
+            EGL_CONTEXT_MINOR_VERSION, 3,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE
+        };
+        context = eglCreateContext(display, config, EGL_NO_CONTEXT, context_attribs);
+        if (context == EGL_NO_CONTEXT) {
+            error = "cannot create a GL 3.3 core context";
+            return false;
+        }
+        if (!hasExtension(eglQueryString(display, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context")) {
+            const EGLint pbuffer_attribs[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+            surface = eglCreatePbufferSurface(display, config, pbuffer_attribs);
+            if (surface == EGL_NO_SURFACE) {
+                error = "cannot create a pbuffer";
+                return false;
+            }
+        }
+        if (!eglMakeCurrent(display, surface, surface, context)) {
+            error = "cannot make the context current";
+            return false;
+        }
+        width = w;
+        height = h;
+        return true;
+    }
+
+    /* Needs GL entry points loaded; all drawing then lands in the framebuffer */
+    bool init (std::string& error)
+    {
+        glGenFramebuffers(1, &framebuffer);
+        glGenRenderbuffers(1, &color);
+        glGenRenderbuffers(1, &depth);
+        glBindRenderbuffer(GL_RENDERBUFFER, color);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, depth);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            error = "framebuffer incomplete";
+            return false;
+        }
+        glDrawBuffer(GL_COLOR_ATTACHMENT0);
+        glReadBuffer(GL_COLOR_ATTACHMENT0);
+        return true;
+    }
+
+    /* The finished frame as RGBA, bottom row first */
+    void readPixels (std::vector<unsigned char>& rgba) const
+    {
+        rgba.resize((size_t) width * height * 4);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, &rgba[0]);
+    }
+
+    void destroy ()
+    {
+        if (display == EGL_NO_DISPLAY)
+            return;
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (surface != EGL_NO_SURFACE)
+            eglDestroySurface(display, surface);
+        if (context != EGL_NO_CONTEXT)
+            eglDestroyContext(display, context);
+        eglTerminate(display);
+        display = EGL_NO_DISPLAY;
+    }
+};
+
+#endif
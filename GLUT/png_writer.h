@@ -0,0 +1,112 @@
+#ifndef PNG_WRITER_H
+#define PNG_WRITER_H
+
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+
+/* Minimal PNG encoder for frame dumps: 8-bit RGB, no filtering, and the
+   zlib stream made of stored (uncompressed) deflate blocks. Files are
+   larger than a real encoder's but it needs no library. */
+struct PngWriter {
+    uint32_t crc_table[256];
+
+    PngWriter ()
+    {
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++)
+                c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            crc_table[n] = c;
+        }
+    }
+
+    uint32_t crc (uint32_t c, const unsigned char* p, size_t n) const
+    {
+        c = ~c;
+        for (size_t i = 0; i < n; i++)
+            c = crc_table[(c ^ p[i]) & 0xff] ^ (c >> 8);
+        return ~c;
+    }
+
+    static void put32 (std::vector<unsigned char>& out, uint32_t v)
+    {
+        out.push_back(v >> 24);
+        out.push_back(v >> 16);
+        out.push_back(v >> 8);
+        out.push_back(v);
+    }
+
+    bool chunk (FILE* f, const char* type, const std::vector<unsigned char>& data) const
+    {
+        std::vector<unsigned char> head;
+        put32(head, data.size());
+        head.insert(head.end(), type, type + 4);
+        uint32_t c = crc(0, &head[4], 4);
+        if (!data.empty())
+            c = crc(c, &data[0], data.size());
+        std::vector<unsigned char> tail;
+        put32(tail, c);
+        return fwrite(&head[0], 1, 8, f) == 8 &&
+               (data.empty() || fwrite(&data[0], 1, data.size(), f) == data.size()) &&
+               fwrite(&tail[0], 1, 4, f) == 4;
+    }
+
+    /* 'rgba' is width*height RGBA pixels, bottom row first as glReadPixels
+       returns them; the image is written top row first */
+    bool write (const char* path, int width, int height, const unsigned char* rgba) const
+    {
+        // scanlines: a filter byte (0, none) then RGB
+        std::vector<unsigned char> raw;
+        raw.reserve((size_t) height * (1 + 3 * width));
+        for (int y = height - 1; y >= 0; y--) {
+            raw.push_back(0);
+            const unsigned char* row = rgba + (size_t) y * width * 4;
+            for (int x = 0; x < width; x++)
+                raw.insert(raw.end(), row + 4 * x, row + 4 * x + 3);
+        }
+
+        // zlib header, stored blocks of at most 65535 bytes, adler32
+        std::vector<unsigned char> z;
+        z.push_back(0x78);
+        z.push_back(0x01);
+        size_t pos = 0;
+        do {
+            size_t n = raw.size() - pos < 65535 ? raw.size() - pos : 65535;
+            z.push_back(pos + n == raw.size() ? 1 : 0);
+            z.push_back(n & 0xff);
+            z.push_back(n >> 8);
+            z.push_back(~n & 0xff);
+            z.push_back((~n >> 8) & 0xff);
+            z.insert(z.end(), raw.begin() + pos, raw.begin() + pos + n);
+            pos += n;
+        } while (pos < raw.size());
+        uint32_t a = 1, b = 0;
+        for (size_t i = 0; i < raw.size(); i++) {
+            a = (a + raw[i]) % 65521;
+            b = (b + a) % 65521;
+        }
+        put32(z, (b << 16) | a);
+
+        std::vector<unsigned char> ihdr;
+        put32(ihdr, width);
+        put32(ihdr, height);
+        ihdr.push_back(8);      // bit depth
+        ihdr.push_back(2);      // colour type: RGB
+        ihdr.push_back(0);      // deflate
+        ihdr.push_back(0);      // adaptive filtering
+        ihdr.push_back(0);      // no interlace
+
+        FILE* f = fopen(path, "wb");
+        if (!f)
+            return false;
+        static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+        bool ok = fwrite(signature, 1, 8, f) == 8 &&
+                  chunk(f, "IHDR", ihdr) &&
+                  chunk(f, "IDAT", z) &&
+                  chunk(f, "IEND", std::vector<unsigned char>());
+        return (fclose(f) == 0) && ok;
+    }
+};
+
+#endif
@@ -0,0 +1,149 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+#include "frame_arena.h"
+
+/* Phases of a frame that the profiler times */
+enum ProfilePhase {
+    PHASE_FRAME,        // start of one frame to the start of the next
+    PHASE_INPUT,
+    PHASE_SPAWN,
+    PHASE_INTEGRATE,
+    PHASE_COLLIDE,
+    PHASE_RENDER,       // building and submitting draw calls
+    PHASE_SWAP,
+    PHASE_COUNT
+};
+
+static const char* const PHASE_NAMES[PHASE_COUNT] = {
+    "frame", "input", "spawn", "integrate", "collide", "render", "swap"
+};
+
+/* Percentile (0..100) of the samples still held in a ring buffer that has
+   had 'recorded' values written to it in total */
+inline double ringPercentile (const std::vector<double>& ring, long long recorded, double pct)
+{
+    size_t n = (size_t) std::min<long long>(recorded, (long long) ring.size());
+    if (n == 0)
+        return 0;
+    FrameVector<double> sorted(ring.begin(), ring.begin() + n);
+    size_t k = std::min(n - 1, (size_t) (pct / 100.0 * n));
+    std::nth_element(sorted.begin(), sorted.begin() + k, sorted.end());
+    return sorted[k];
+}
+
+/* Small id for the calling thread, in the order threads first ask */
+inline int traceThreadId ()
+{
+    static std::atomic<int> next(1);
+    thread_local int id = next++;
+    return id;
+}
+
+/* CPU profiler - keeps the last RING_SIZE durations of every phase for
+   percentiles, and the last TRACE_SIZE timed scopes for a Chrome trace.
+   Any thread may record, as long as each phase is only timed on one, and
+   only that thread may read the phase (last(), percentile()) while it
+   runs. Trace events from all threads share one ring; writeTrace() and
+   report() must wait until the other threads have stopped. */
+struct Profiler {
+    enum { RING_SIZE = 4096, TRACE_SIZE = 65536 };
+
+    struct TraceEvent {
+        int phase, tid;
+        double start_us, duration_us;
+    };
+
+    bool enabled;
+    std::chrono::steady_clock::time_point origin;
+    std::vector<double> samples[PHASE_COUNT];   // microseconds, ring buffers
+    long long recorded[PHASE_COUNT];
+    std::vector<TraceEvent> trace;
+    std::atomic<long long> traced;
+
+    Profiler () : enabled(false), origin(std::chrono::steady_clock::now()), traced(0)
+    {
+        for (int p = 0; p < PHASE_COUNT; p++) {
+            samples[p].resize(RING_SIZE);
+            recorded[p] = 0;
+        }
+        trace.resize(TRACE_SIZE);
+    }
+
+    /* Microseconds since the profiler was created */
+    double now () const
+    {
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - origin).count();
+    }
+
+    void record (int phase, double start_us, double duration_us)
+    {
+        samples[phase][recorded[phase]++ % RING_SIZE] = duration_us;
+        TraceEvent e = { phase, traceThreadId(), start_us, duration_us };
+        trace[traced++ % TRACE_SIZE] = e;
+    }
+
+    /* Most recent duration of a phase in microseconds */
+    double last (int phase) const
+    {
+        return recorded[phase] ? samples[phase][(recorded[phase] - 1) % RING_SIZE] : 0;
+    }
+
+    /* Percentile (0..100) over the samples still in the ring */
+    double percentile (int phase, double pct) const
+    {
+        return ringPercentile(samples[phase], recorded[phase], pct);
+    }
+
+    void report (FILE* out) const
+    {
+        fprintf(out, "%-10s %10s %10s %10s %10s %10s\n", "phase(us)", "samples", "p50", "p90", "p99", "max");
+        for (int p = 0; p < PHASE_COUNT; p++) {
+            if (recorded[p] == 0)
+                continue;
+            fprintf(out, "%-10s %10lld %10.1f %10.1f %10.1f %10.1f\n", PHASE_NAMES[p], recorded[p],
+                    percentile(p, 50), percentile(p, 90), percentile(p, 99), percentile(p, 100));
+        }
+    }
+
+    /* Dump the retained scopes in Chrome trace-event format (chrome://tracing, Perfetto) */
+    bool writeTrace (const char* path) const
+    {
+        FILE* f = fopen(path, "w");
+        if (!f)
+            return false;
+        long long count = traced;
+        long long first = count > TRACE_SIZE ? count - TRACE_SIZE : 0;
+        fprintf(f, "{\"traceEvents\":[\n");
+        for (long long i = first; i < count; i++) {
+            const TraceEvent& e = trace[i % TRACE_SIZE];
+            fprintf(f, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                    i == first ? "" : ",\n", PHASE_NAMES[e.phase], e.tid, e.start_us, e.duration_us);
+        }
+        fprintf(f, "\n],\"displayTimeUnit\":\"ms\"}\n");
+        fclose(f);
+        return true;
+    }
+};
+
+/* Times the enclosing scope as one phase; does nothing while profiling is off */
+struct ProfileScope {
+    Profiler& profiler;
+    int phase;
+    double start;
+
+    ProfileScope (Profiler& p, int ph) : profiler(p), phase(ph), start(p.enabled ? p.now() : 0) {}
+    ~ProfileScope ()
+    {
+        if (profiler.enabled)
+            profiler.record(phase, start, profiler.now() - start);
+    }
+};
+
+#endif
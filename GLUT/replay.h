@@ -0,0 +1,145 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <vector>
+
+/* Small self-contained PRNG (xorshift64*) so a seed fully determines a game,
+   whatever the platform's rand() does */
+struct Rng {
+    uint64_t state;
+
+    Rng () { seed(1); }
+    void seed (uint64_t s) { state = s ? s : 0x9E3779B97F4A7C15ULL; }
+    uint32_t next ()
+    {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return (uint32_t) ((state * 2685821657736338717ULL) >> 32);
+    }
+    /* Uniform-ish integer in 0..n-1 */
+    int below (int n) { return (int) (next() % (uint32_t) n); }
+};
+
+/* Everything from the outside world that can change the simulation */
+enum InputType {
+    INPUT_KEY_UP = 1,
+    INPUT_SPECIAL_DOWN,
+    INPUT_MOUSE_BUTTON,
+    INPUT_MOUSE_MOTION,
+    INPUT_AIM,              // set the barrel angle directly (headless bot)
+    INPUT_END = 0xff        // end of a journal, followed by the state hash
+};
+
+struct InputEvent {
+    uint32_t tick;          // simulation tick the event is applied before
+    uint8_t type;
+    uint8_t code;           // key or mouse button
+    uint8_t state;          // mouse button state
+    int16_t x, y;           // mouse position, or angle for INPUT_AIM
+};
+
+/* FNV-1a over raw bytes, used to fingerprint the game state each tick */
+inline uint64_t hashBytes (uint64_t h, const void* data, size_t n)
+{
+    const unsigned char* p = (const unsigned char*) data;
+    for (size_t i = 0; i < n; i++) {
+        h ^= p[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+/* Compact binary journal of a session:
+     header  "BBRJ", u32 version, u64 seed, u32 sim_hz (1 to 2^31-1)
+     events  u32 tick, u8 type, u8 code, u8 state, i16 x, i16 y   (11 bytes)
+     end     an INPUT_END event whose tick is the tick count, then u64 hash
+   Fields are written in host byte order. */
+struct Journal {
+    enum { VERSION = 1 };
+
+    FILE* file;
+    uint64_t seed;
+    uint32_t sim_hz;
+
+    Journal () : file(NULL), seed(0), sim_hz(0) {}
+
+    bool openWrite (const char* path, uint64_t s, uint32_t hz)
+    {
+        file = fopen(path, "wb");
+        if (!file)
+            return false;
+        seed = s;
+        sim_hz = hz;
+        uint32_t version = VERSION;
+        fwrite("BBRJ", 1, 4, file);
+        fwrite(&version, sizeof(version), 1, file);
+        fwrite(&seed, sizeof(seed), 1, file);
+        fwrite(&sim_hz, sizeof(sim_hz), 1, file);
+        return true;
+    }
+
+    void write (const InputEvent& e)
+    {
+        if (!file)
+            return;
+        fwrite(&e.tick, sizeof(e.tick), 1, file);
+        fwrite(&e.type, 1, 1, file);
+        fwrite(&e.code, 1, 1, file);
+        fwrite(&e.state, 1, 1, file);
+        fwrite(&e.x, sizeof(e.x), 1, file);
+        fwrite(&e.y, sizeof(e.y), 1, file);
+    }
+
+    void close (uint32_t ticks, uint64_t hash)
+    {
+        if (!file)
+            return;
+        InputEvent end = { ticks, INPUT_END, 0, 0, 0, 0 };
+        write(end);
+        fwrite(&hash, sizeof(hash), 1, file);
+        fclose(file);
+        file = NULL;
+    }
+
+    /* Read a whole journal; 'end' receives the INPUT_END record */
+    bool read (const char* path, std::vector<InputEvent>& events, InputEvent& end, uint64_t& hash)
+    {
+        FILE* f = fopen(path, "rb");
+        if (!f)
+            return false;
+        char magic[4];
+        uint32_t version = 0;
+        bool ok = fread(magic, 1, 4, f) == 4 && memcmp(magic, "BBRJ", 4) == 0 &&
+                  fread(&version, sizeof(version), 1, f) == 1 && version == VERSION &&
+                  fread(&seed, sizeof(seed), 1, f) == 1 &&
+                  fread(&sim_hz, sizeof(sim_hz), 1, f) == 1 &&
+                  sim_hz >= 1 && sim_hz <= INT32_MAX;    // what --hz accepts
+        bool ended = false;
+        while (ok && !ended) {
+            InputEvent e;
+            ok = fread(&e.tick, sizeof(e.tick), 1, f) == 1 &&
+                 fread(&e.type, 1, 1, f) == 1 &&
+                 fread(&e.code, 1, 1, f) == 1 &&
+                 fread(&e.state, 1, 1, f) == 1 &&
+                 fread(&e.x, sizeof(e.x), 1, f) == 1 &&
+                 fread(&e.y, sizeof(e.y), 1, f) == 1;
+            if (!ok)
+                break;
+            if (e.type == INPUT_END) {
+                end = e;
+                ok = fread(&hash, sizeof(hash), 1, f) == 1;
+                ended = true;
+            }
+            else
+                events.push_back(e);
+        }
+        fclose(f);
+        return ok && ended;
+    }
+};
+
+#endif
@@ -0,0 +1,99 @@
+#ifndef SCENE_GRAPH_H
+#define SCENE_GRAPH_H
+
+#include <cmath>
+#include <vector>
+
+/* A 2D placement as Sample_GL.vert applies it: stretch along x by scale_x,
+   rotate by 'angle' radians, then move to (x, y) */
+struct Placement {
+    float x, y, angle, scale_x;
+
+    bool operator== (const Placement& o) const
+    {
+        return x == o.x && y == o.y && angle == o.angle && scale_x == o.scale_x;
+    }
+    bool operator!= (const Placement& o) const { return !(*this == o); }
+};
+
+inline Placement placement (float x, float y, float angle = 0, float scale_x = 1)
+{
+    Placement p = { x, y, angle, scale_x };
+    return p;
+}
+
+/* 'child' placed in the frame of 'parent'. Stays a Placement as long as the
+   child does not rotate inside a parent that stretches. */
+inline Placement compose (const Placement& parent, const Placement& child)
+{
+    float c = cosf(parent.angle), s = sinf(parent.angle);
+    float lx = child.x * parent.scale_x, ly = child.y;
+    return placement(parent.x + c * lx - s * ly, parent.y + s * lx + c * ly,
+                     parent.angle + child.angle, parent.scale_x * child.scale_x);
+}
+
+/* Flat scene graph - nodes live in arrays, each after its parent, so one
+   forward pass brings every world placement up to date. A node's world
+   placement is cached and only recomputed when its own local placement
+   was changed or its parent's world placement moved in the same pass, so
+   static nodes cost nothing per frame. */
+struct SceneGraph {
+    enum { ROOT = -1 };
+
+    std::vector<int> parent;
+    std::vector<Placement> local, world;
+    std::vector<unsigned char> dirty;
+    std::vector<long long> moved;   // update() pass that last recomputed it
+    long long passes;
+    long long recomputed;           // world placements recomputed, in total
+
+    SceneGraph () : passes(0), recomputed(0) {}
+
+    size_t size () const { return parent.size(); }
+
+    /* New node under 'under' (ROOT or an existing node) */
+    int add (int under, const Placement& p)
+    {
+        parent.push_back(under);
+        local.push_back(p);
+        world.push_back(p);
+        dirty.push_back(1);
+        moved.push_back(-1);
+        return (int) parent.size() - 1;
+    }
+
+    /* Drop every node from 'first' on */
+    void truncate (size_t first)
+    {
+        parent.resize(first);
+        local.resize(first);
+        world.resize(first);
+        dirty.resize(first);
+        moved.resize(first);
+    }
+
+    /* Marks the node dirty only if the placement actually changed */
+    void setLocal (int node, const Placement& p)
+    {
+        if (local[node] != p) {
+            local[node] = p;
+            dirty[node] = 1;
+        }
+    }
+
+    void update ()
+    {
+        passes++;
+        for (size_t i = 0; i < parent.size(); i++) {
+            int up = parent[i];
+            if (!dirty[i] && (up == ROOT || moved[up] != passes))
+                continue;
+            world[i] = up == ROOT ? local[i] : compose(world[up], local[i]);
+            dirty[i] = 0;
+            moved[i] = passes;
+            recomputed++;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,136 @@
+#ifndef SCORE_DISPLAY_H
+#define SCORE_DISPLAY_H
+
+#include <vector>
+#include <GL/glew.h>
+
+#include "gl_state.h"
+
+/* Seven-segment digits */
+enum Segment {
+    SEG_BOTTOM      = 1 << 0,
+    SEG_MIDDLE      = 1 << 1,
+    SEG_TOP         = 1 << 2,
+    SEG_LOWER_LEFT  = 1 << 3,
+    SEG_UPPER_LEFT  = 1 << 4,
+    SEG_LOWER_RIGHT = 1 << 5,
+    SEG_UPPER_RIGHT = 1 << 6
+};
+
+constexpr unsigned char DIGIT_SEGMENTS[10] = {
+    SEG_BOTTOM | SEG_TOP | SEG_LOWER_LEFT | SEG_UPPER_LEFT | SEG_LOWER_RIGHT | SEG_UPPER_RIGHT,  // 0
+    SEG_LOWER_RIGHT | SEG_UPPER_RIGHT,                                                           // 1
+    SEG_BOTTOM | SEG_MIDDLE | SEG_TOP | SEG_LOWER_LEFT | SEG_UPPER_RIGHT,                        // 2
+    SEG_BOTTOM | SEG_MIDDLE | SEG_TOP | SEG_LOWER_RIGHT | SEG_UPPER_RIGHT,                       // 3
+    SEG_MIDDLE | SEG_UPPER_LEFT | SEG_LOWER_RIGHT | SEG_UPPER_RIGHT,                             // 4
+    SEG_BOTTOM | SEG_MIDDLE | SEG_TOP | SEG_UPPER_LEFT | SEG_LOWER_RIGHT,                        // 5
+    SEG_BOTTOM | SEG_MIDDLE | SEG_TOP | SEG_LOWER_LEFT | SEG_UPPER_LEFT | SEG_LOWER_RIGHT,       // 6
+    SEG_TOP | SEG_LOWER_RIGHT | SEG_UPPER_RIGHT,                                                 // 7
+    SEG_BOTTOM | SEG_MIDDLE | SEG_TOP | SEG_LOWER_LEFT | SEG_UPPER_LEFT | SEG_LOWER_RIGHT | SEG_UPPER_RIGHT, // 8
+    SEG_BOTTOM | SEG_MIDDLE | SEG_TOP | SEG_UPPER_LEFT | SEG_LOWER_RIGHT | SEG_UPPER_RIGHT       // 9
+};
+
+/* Rectangle (x, y, width, height) of each segment, relative to the
+   bottom-left corner of its digit, in the same bit order as Segment */
+struct SegmentRect { float x, y, w, h; };
+constexpr SegmentRect SEGMENT_RECTS[7] = {
+    { 0.05f, 0.0f,  0.3f,  0.1f },   // bottom
+    { 0.05f, 0.3f,  0.3f,  0.1f },   // middle
+    { 0.05f, 0.6f,  0.3f,  0.1f },   // top
+    { 0.0f,  0.05f, 0.05f, 0.3f },   // lower left
+    { 0.0f,  0.35f, 0.05f, 0.3f },   // upper left
+    { 0.35f, 0.05f, 0.05f, 0.3f },   // lower right
+    { 0.35f, 0.35f, 0.05f, 0.3f }    // upper right
+};
+
+/* Draws a signed number of any length, right-aligned so its last digit
+   starts at (x, y), as one dynamic batch of flat black triangles in the
+   same x,y,z,r,g,b layout as the static meshes. The batch is rebuilt
+   and re-uploaded only when the number changes. */
+struct ScoreDisplay {
+    enum { MIN_DIGITS = 2 };
+    static constexpr float DIGIT_PITCH = 0.5f;
+
+    float x, y;
+    GLuint VertexArrayID;
+    GLuint VertexBuffer;
+    GLsizei NumVertices;
+    long long shown;
+    bool built;
+    std::vector<GLfloat> vertices;
+
+    ScoreDisplay (float right_x, float base_y) : x(right_x), y(base_y), NumVertices(0), shown(0), built(false) {}
+
+    static void addRect (std::vector<GLfloat>& out, float x0, float y0, float w, float h)
+    {
+        const float corners[6][2] = { {x0, y0}, {x0 + w, y0}, {x0 + w, y0 + h},
+                                      {x0 + w, y0 + h}, {x0, y0 + h}, {x0, y0} };
+        for (int v = 0; v < 6; v++) {
+            GLfloat vertex[6] = { corners[v][0], corners[v][1], 0, 0, 0, 0 };
+            out.insert(out.end(), vertex, vertex + 6);
+        }
+    }
+
+    /* Triangles for 'value'; at least MIN_DIGITS digits, with a leading minus if negative */
+    static void build (long long value, float right_x, float base_y, std::vector<GLfloat>& out)
+    {
+        out.clear();
+        unsigned long long magnitude = value < 0 ? 0ULL - (unsigned long long) value : (unsigned long long) value;
+        char digits[24];
+        int n = 0;
+        do {
+            digits[n++] = magnitude % 10;
+            magnitude /= 10;
+        } while (magnitude);
+        while (n < MIN_DIGITS)
+            digits[n++] = 0;
+
+        // digits[] is least significant first; place each one leftwards from right_x
+        for (int k = 0; k < n; k++) {
+            float ox = right_x - DIGIT_PITCH * k;
+            unsigned char segments = DIGIT_SEGMENTS[(int) digits[k]];
+            for (int s = 0; s < 7; s++)
+                if (segments & (1 << s))
+                    addRect(out, ox + SEGMENT_RECTS[s].x, base_y + SEGMENT_RECTS[s].y, SEGMENT_RECTS[s].w, SEGMENT_RECTS[s].h);
+        }
+        if (value < 0) {
+            float ox = right_x - DIGIT_PITCH * (n - 1) - 0.55f;
+            addRect(out, ox, base_y + SEGMENT_RECTS[1].y, SEGMENT_RECTS[1].w, SEGMENT_RECTS[1].h);
+        }
+    }
+
+    /* Needs a current GL context */
+    void init (GLStateCache& gl)
+    {
+        glGenVertexArrays(1, &VertexArrayID);
+        glGenBuffers(1, &VertexBuffer);
+        gl.bindVertexArray(VertexArrayID);
+        gl.bindArrayBuffer(VertexBuffer);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6*sizeof(GLfloat), (void*)0);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6*sizeof(GLfloat), (void*)(3*sizeof(GLfloat)));
+        glEnableVertexAttribArray(0);
+        glEnableVertexAttribArray(1);
+    }
+
+    void update (long long value, GLStateCache& gl)
+    {
+        if (built && value == shown)
+            return;
+        build(value, x, y, vertices);
+        gl.bindArrayBuffer(VertexBuffer);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size()*sizeof(GLfloat), &vertices[0], GL_DYNAMIC_DRAW);
+        NumVertices = vertices.size() / 6;
+        shown = value;
+        built = true;
+    }
+
+    /* One draw call; the caller sets an identity placement as the Model uniform */
+    void draw (GLStateCache& gl)
+    {
+        gl.bindVertexArray(VertexArrayID);
+        gl.polygonMode(GL_FILL);
+        glDrawArrays(GL_TRIANGLES, 0, NumVertices);
+    }
+};
+
+#endif
@@ -0,0 +1,123 @@
+#ifndef SHADER_CACHE_H
+#define SHADER_CACHE_H
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <sys/stat.h>
+#include <GL/glew.h>
+
+/* On-disk cache of linked program binaries (glGetProgramBinary / glProgramBinary).
+   Entries are keyed on a hash of the shader sources and the driver's vendor,
+   renderer and version strings, so a driver update or a shader edit simply
+   misses the cache. A blob the driver refuses to load is ignored and the
+   program is compiled from source as usual, which then rewrites the entry. */
+struct ShaderCache {
+    bool enabled;
+    std::string dir;
+
+    ShaderCache () : enabled(true), dir("shader_cache") {}
+
+    static uint64_t fnv1a (uint64_t h, const std::string& s)
+    {
+        for (size_t i = 0; i < s.size(); i++) {
+            h ^= (unsigned char) s[i];
+            h *= 1099511628211ULL;
+        }
+        h ^= 0xff;   // separator, so ("ab","c") and ("a","bc") differ
+        return h * 1099511628211ULL;
+    }
+
+    static std::string glString (GLenum name)
+    {
+        const GLubyte* s = glGetString(name);
+        return s ? std::string((const char*) s) : std::string();
+    }
+
+    /* Usable only if the driver can hand out at least one binary format */
+    bool supported () const
+    {
+        if (!enabled || !(GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary))
+            return false;
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        return formats > 0;
+    }
+
+    std::string path (const std::string& vertex_code, const std::string& fragment_code) const
+    {
+        uint64_t h = 14695981039346656037ULL;
+        h = fnv1a(h, vertex_code);
+        h = fnv1a(h, fragment_code);
+        h = fnv1a(h, glString(GL_VENDOR));
+        h = fnv1a(h, glString(GL_RENDERER));
+        h = fnv1a(h, glString(GL_VERSION));
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long) h);
+        return dir + "/" + name;
+    }
+
+    /* Returns a linked program, or 0 if there is no usable entry */
+    GLuint load (const std::string& file) const
+    {
+        FILE* f = fopen(file.c_str(), "rb");
+        if (!f)
+            return 0;
+        char magic[4];
+        GLenum format;
+        uint32_t length;
+        std::vector<char> blob;
+        bool ok = fread(magic, 1, 4, f) == 4 && memcmp(magic, "GLPB", 4) == 0 &&
+                  fread(&format, sizeof(format), 1, f) == 1 &&
+                  fread(&length, sizeof(length), 1, f) == 1 && length > 0;
+        if (ok) {
+            blob.resize(length);
+            ok = fread(&blob[0], 1, length, f) == length;
+        }
+        fclose(f);
+        if (!ok)
+            return 0;
+
+        GLuint program = glCreateProgram();
+        glProgramBinary(program, format, &blob[0], length);
+        GLint linked = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        if (linked != GL_TRUE) {
+            fprintf(stdout, "Shader cache: driver rejected %s, recompiling\n", file.c_str());
+            glDeleteProgram(program);
+            return 0;
+        }
+        return program;
+    }
+
+    /* Write the binary of a linked program; failures only cost the next start */
+    void save (const std::string& file, GLuint program) const
+    {
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return;
+        std::vector<char> blob(length);
+        GLenum format = 0;
+        glGetProgramBinary(program, length, NULL, &format, &blob[0]);
+
+        mkdir(dir.c_str(), 0755);
+        std::string tmp = file + ".tmp";
+        FILE* f = fopen(tmp.c_str(), "wb");
+        if (!f)
+            return;
+        uint32_t len = length;
+        bool ok = fwrite("GLPB", 1, 4, f) == 4 &&
+                  fwrite(&format, sizeof(format), 1, f) == 1 &&
+                  fwrite(&len, sizeof(len), 1, f) == 1 &&
+                  fwrite(&blob[0], 1, len, f) == len;
+        ok = (fclose(f) == 0) && ok;
+        // rename so a crash mid-write never leaves a truncated entry behind
+        if (!ok || rename(tmp.c_str(), file.c_str()) != 0)
+            remove(tmp.c_str());
+    }
+};
+
+#endif
@@ -0,0 +1,242 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include <cmath>
+#include <vector>
+#include <cstdint>
+
+#include "entity_store.h"
+#include "spatial_grid.h"
+#include "mirror.h"
+#include "level.h"
+#include "replay.h"
+#include "bullet_kernels.h"
+
+/* The game's entity stores and the kernels that move and collide them.
+   No GL and no game globals, so the same code runs in the game, in
+   headless mode and in the benchmark (make bench). */
+
+const float BULLET_RADIUS = 0.025f;
+const float MUZZLE_X = -3.75f;     // x of the cannon mouth, where bullets start
+
+/* Falling bricks - one densely packed store for all three colours.
+   Every brick is also filed by slot in a grid over the -4..4 field, one
+   layer per colour so collisions can look for each colour in turn. The
+   grid starts at 16x16 and doubles its resolution whenever the store
+   outgrows BRICKS_PER_CELL bricks per cell (all layers together), up to
+   MAX_CELLS a side. That keeps down how many bricks a collide query
+   tests - about 1 to 11 from 10^2 to 10^6 bricks, rising again once the
+   grid stops growing - but not its cost, which still climbs with the
+   count as more of the lookups miss the cache (make bench).
+   clear() keeps the resolution, so refilling the store does not rebuild
+   it. A game never has enough bricks to leave 16x16. */
+enum BrickType { BRICK_RED, BRICK_BLACK, BRICK_GREEN, BRICK_TYPES };
+struct BrickStore {
+    enum { BASE_CELLS = 16, MAX_CELLS = 128, BRICKS_PER_CELL = 12 };
+
+    EntityIndex ids;
+    std::vector<float> x, y;
+    std::vector<unsigned char> type;
+    std::vector<int> cell;
+    SpatialGrid grid;
+
+    BrickStore () : grid(-4, 4, BASE_CELLS, BRICK_TYPES) {}
+    size_t size () const { return ids.size(); }
+    EntityHandle add (float bx, float by, int btype)
+    {
+        x.push_back(bx);
+        y.push_back(by);
+        type.push_back((unsigned char) btype);
+        EntityHandle h = ids.add();
+        cell.push_back(grid.cellOf(bx, by, btype));
+        grid.insert(h.slot, cell.back());
+        if (grid.dim < MAX_CELLS && size() > (size_t) grid.dim * grid.dim * BRICKS_PER_CELL)
+            regrid(grid.dim * 2);
+        return h;
+    }
+    /* Re-file every brick, in dense order, in a grid of 'cells' a side */
+    void regrid (int cells)
+    {
+        grid = SpatialGrid(-4, 4, cells, BRICK_TYPES);
+        for (size_t i = 0; i < size(); i++) {
+            cell[i] = grid.cellOf(x[i], y[i], type[i]);
+            grid.insert(ids.slot_of[i], cell[i]);
+        }
+    }
+    /* Move brick i, re-filing it in the grid only when it changes cell */
+    void setY (size_t i, float by)
+    {
+        y[i] = by;
+        cell[i] = grid.move(ids.slot_of[i], cell[i], x[i], by, type[i]);
+    }
+    void remove (size_t i)
+    {
+        grid.erase(ids.slot_of[i], cell[i]);
+        swapPop(x, i);
+        swapPop(y, i);
+        swapPop(type, i);
+        swapPop(cell, i);
+        ids.remove(i);
+    }
+    void clear ()
+    {
+        x.clear();
+        y.clear();
+        type.clear();
+        cell.clear();
+        grid.clear();
+        ids.clear();
+    }
+};
+
+/* Live bullets, in world coordinates, each moving along the unit vector vx,vy.
+   A fixed-capacity pool: every column is allocated at full size up front
+   and only the first size() entries are live, so firing and retiring
+   never touch the heap, and a retired bullet's slot is handed to the next
+   one fired. add() on a full pool adds nothing. */
+const size_t BULLET_CAPACITY = 4096;
+struct BulletStore {
+    size_t capacity;
+    size_t count;                         // live bullets, at 0..count-1 in every column
+    EntityIndex ids;
+    std::vector<float> x, y;
+    std::vector<float> px, py;            // x, y at the previous tick, for interpolation
+    std::vector<float> vx, vy;            // unit heading, always headingVector(angle)
+    std::vector<float> angle;             // degrees
+    std::vector<int> last_mirror;         // mirror bounced off most recently, -1 for none
+
+    BulletStore (size_t n = BULLET_CAPACITY)
+        : capacity(n), count(0), x(n), y(n), px(n), py(n), vx(n), vy(n), angle(n), last_mirror(n)
+    {
+        ids.reserve(n);
+    }
+    size_t size () const { return count; }
+    bool full () const { return count >= capacity; }
+    /* Not valid() if the pool is full */
+    EntityHandle add (float bx, float by, float a)
+    {
+        if (full()) {
+            EntityHandle none = { EntityIndex::NO_SLOT, 0 };
+            return none;
+        }
+        x[count] = bx;
+        y[count] = by;
+        px[count] = bx;
+        py[count] = by;
+        headingVector(a, vx[count], vy[count]);
+        angle[count] = a;
+        last_mirror[count] = -1;
+        count++;
+        return ids.add();
+    }
+    void remove (size_t i)
+    {
+        swapRemove(x, i, count);
+        swapRemove(y, i, count);
+        swapRemove(px, i, count);
+        swapRemove(py, i, count);
+        swapRemove(vx, i, count);
+        swapRemove(vy, i, count);
+        swapRemove(angle, i, count);
+        swapRemove(last_mirror, i, count);
+        ids.remove(i);
+        count--;
+    }
+    void clear ()
+    {
+        ids.clear();
+        count = 0;
+    }
+};
+
+/* One spawn roll: maybe a new brick at the top of a random lane.
+   Returns the SpawnKind rolled. */
+inline int spawnBrick (BrickStore& bricks, const Level& level, Rng& rng)
+{
+    int kind = level.rollKind(rng);
+    float position = level.rollLane(rng);
+    if (kind == SPAWN_RED)
+        bricks.add(position, 4, BRICK_RED);
+    else if (kind == SPAWN_BLACK)
+        bricks.add(position, 4, BRICK_BLACK);
+    else if (kind == SPAWN_GREEN)
+        bricks.add(position, 4, BRICK_GREEN);
+    return kind;
+}
+
+/* Moves every bullet 'step' along its heading, bouncing off the mirrors,
+   and retires the ones that have left the screen. The bulk of the work is
+   one pass of the SIMD kernel; only the few bullets it flags as near a
+   mirror redo their step with the exact sweep. */
+struct BulletIntegrator {
+    BulletKernel kernel;
+    MirrorColumns columns;
+    std::vector<unsigned char> flags;
+
+    void run (BulletStore& bullets, const std::vector<Mirror>& mirrors, float step)
+    {
+        size_t n = bullets.size();
+        if (n == 0)
+            return;
+        columns.build(mirrors, step, BULLET_RADIUS);
+        flags.resize(n);
+        kernel.move(&bullets.x[0], &bullets.y[0], &bullets.px[0], &bullets.py[0],
+                    &bullets.vx[0], &bullets.vy[0], &flags[0], n, step, columns);
+
+        for (size_t i = 0; i < n; i++) {
+            if (flags[i] != BULLET_NEAR_MIRROR)
+                continue;
+            float x = bullets.px[i], y = bullets.py[i];
+            if (sweepMirrors(mirrors, x, y, bullets.angle[i], bullets.last_mirror[i], step, BULLET_RADIUS))
+                headingVector(bullets.angle[i], bullets.vx[i], bullets.vy[i]);
+            bullets.x[i] = x;
+            bullets.y[i] = y;
+        }
+
+        // same swap-and-pop order as retiring them one by one in a single loop
+        for (size_t i = 0; i < bullets.size();) {
+            if (flags[i] & BULLET_CULL) {
+                swapPop(flags, i);
+                bullets.remove(i);
+            }
+            else
+                i++;
+        }
+    }
+};
+
+/* The order a bullet looks for bricks in when it overlaps several:
+   black, then red, then green, as the game always has */
+static const int HIT_ORDER[BRICK_TYPES] = { BRICK_BLACK, BRICK_RED, BRICK_GREEN };
+
+/* A bullet is spent on one brick it overlaps; shooting black scores,
+   red or green costs. Returns the change in score. */
+inline int shootBricks (BulletStore& bullets, BrickStore& bricks)
+{
+    int delta = 0;
+    size_t j = 0;
+    for (size_t i = 0; i < bullets.size();) {
+        float cx = bullets.x[i];
+        float cy = bullets.y[i];
+        // broadphase: only bricks of one colour filed in cells around the bullet
+        bool hit = false;
+        for (int t = 0; t < BRICK_TYPES && !hit; t++)
+            hit = bricks.grid.query(cx - 0.075, cy - 0.3, cx + 0.075, cy + 0.3, [&](uint32_t slot) {
+                j = bricks.ids.dense_of[slot];
+                return (fabsf(bricks.x[j] - cx) <= 0.075) && (fabsf(bricks.y[j] - cy) <= 0.3);
+            }, HIT_ORDER[t]);
+        if (!hit) {
+            i++;
+            continue;
+        }
+        if (bricks.type[j] == BRICK_BLACK)
+            delta += 2;     // perfect shoot
+        else
+            delta -= 2;
+        bricks.remove(j);
+        bullets.remove(i);
+    }
+    return delta;
+}
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <atomic>
+#include <vector>
+
+#include "mirror.h"
+
+/* Everything draw() needs from the simulation, copied out after a tick.
+   Once published a snapshot is never written again until the renderer
+   has let go of it, so drawing needs no locks. The vectors keep their
+   capacity between uses, so steady-state copying does not allocate. */
+struct Snapshot {
+    long long tick;                 // -1 until the first tick is published
+    long long published_ms;         // game clock when it was published
+    float alpha;                    // render_alpha at that moment
+    int score;
+    const char* game_over;
+    float mov1, mov2, movcannon, rotatecannon;
+    float zoom, xchang, ychang;
+    float basket_width[2];
+    double collide_us;              // last collide phase, for the profiler title
+    std::vector<Mirror> mirrors;
+    std::vector<float> brick_x, brick_y;
+    std::vector<unsigned char> brick_type;
+    std::vector<float> bullet_x, bullet_y, bullet_px, bullet_py, bullet_angle;
+
+    Snapshot () : tick(-1), published_ms(0), alpha(1), score(0), game_over(NULL), mov1(0), mov2(0),
+                  movcannon(0), rotatecannon(0), zoom(1), xchang(0), ychang(0), collide_us(0)
+    {
+        basket_width[0] = basket_width[1] = 2;
+    }
+};
+
+/* Lock-free triple buffer between one writer and one reader. The writer
+   fills writable() and publish()es it; the reader calls acquire() and
+   then uses readable() until its next acquire(). Each side owns one
+   buffer and the third is swapped through an atomic, so the writer never
+   waits for the reader and the reader always gets the newest complete
+   buffer, skipping any it was too slow to see. */
+template <class T>
+struct TripleBuffer {
+    enum { FRESH = 4 };     // set in 'middle' when it holds an unread buffer
+
+    T buffers[3];
+    unsigned back, front;   // owned by the writer and by the reader
+    std::atomic<unsigned> middle;
+
+    TripleBuffer () : back(0), front(1), middle(2) {}
+
+    T& writable () { return buffers[back]; }
+
+    void publish ()
+    {
+        back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & 3;
+    }
+
+    /* Switch to the newest published buffer; false if there is none newer */
+    bool acquire ()
+    {
+        if (!(middle.load(std::memory_order_relaxed) & FRESH))
+            return false;
+        front = middle.exchange(front, std::memory_order_acq_rel) & 3;
+        return true;
+    }
+
+    const T& readable () const { return buffers[front]; }
+};
+
+#endif
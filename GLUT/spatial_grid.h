@@ -0,0 +1,88 @@
+#ifndef SPATIAL_GRID_H
+#define SPATIAL_GRID_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/* Uniform grid over a square play field, used as a collision broadphase.
+   Each cell keeps the ids of the entities whose anchor point lies in it;
+   positions outside the field are clamped to the border cells.
+
+   A query costs the cells it touches plus every entity filed in them, so
+   it only stays cheap while cells hold a handful of entities each: at a
+   fixed resolution the cost grows linearly with density. The owner must
+   pick cells_per_side for the population it expects, or rebuild the grid
+   finer as it grows (BrickStore does).
+
+   Entities can be split over several layers of the same grid, each
+   queried on its own, so a caller that wants one kind before another
+   can stop at the first hit in each layer. */
+struct SpatialGrid {
+    float lo, cell_size;
+    int dim;
+    std::vector< std::vector<uint32_t> > cells;
+
+    SpatialGrid (float field_lo, float field_hi, int cells_per_side, int layers = 1)
+        : lo(field_lo), cell_size((field_hi - field_lo) / cells_per_side),
+          dim(cells_per_side), cells(layers * cells_per_side * cells_per_side) {}
+
+    int column (float v) const
+    {
+        int c = (int) ((v - lo) / cell_size);
+        if (v < lo) c = 0;
+        return c < 0 ? 0 : (c >= dim ? dim - 1 : c);
+    }
+
+    int cellOf (float x, float y, int layer = 0) const { return (layer * dim + column(y)) * dim + column(x); }
+
+    void insert (uint32_t id, int cell) { cells[cell].push_back(id); }
+
+    void erase (uint32_t id, int cell)
+    {
+        std::vector<uint32_t>& c = cells[cell];
+        for (size_t k = 0; k < c.size(); k++)
+            if (c[k] == id) {
+                c[k] = c.back();
+                c.pop_back();
+                return;
+            }
+    }
+
+    /* Re-file an entity after it moved; returns its (possibly unchanged) cell */
+    int move (uint32_t id, int from, float x, float y, int layer = 0)
+    {
+        int to = cellOf(x, y, layer);
+        if (to != from) {
+            erase(id, from);
+            insert(id, to);
+        }
+        return to;
+    }
+
+    void clear ()
+    {
+        for (size_t k = 0; k < cells.size(); k++)
+            cells[k].clear();
+    }
+
+    /* Call visit(id) for every entity of the layer anchored in a cell
+       touching the box. Stops early and returns true as soon as visit
+       returns true. */
+    template <typename Visit>
+    bool query (float x0, float y0, float x1, float y1, Visit visit, int layer = 0) const
+    {
+        int cx0 = column(x0), cx1 = column(x1);
+        int cy0 = column(y0), cy1 = column(y1);
+        for (int cy = cy0; cy <= cy1; cy++)
+            for (int cx = cx0; cx <= cx1; cx++) {
+                const std::vector<uint32_t>& c = cells[(layer * dim + cy) * dim + cx];
+                for (size_t k = 0; k < c.size(); k++)
+                    if (visit(c[k]))
+                        return true;
+            }
+        return false;
+    }
+};
+
+#endif
@@ -0,0 +1,161 @@
+#ifndef STREAM_BUFFER_H
+#define STREAM_BUFFER_H
+
+#include <cstdio>
+#include <GL/glew.h>
+
+#include "gl_state.h"
+
+/* One vertex buffer that all per-frame dynamic data is written into,
+   straight from the loop that produces it.
+
+   Where GL_ARB_buffer_storage exists the buffer is mapped once, for good,
+   and split into REGIONS per-frame regions. A frame writes only its own
+   region; a fence placed after its draws tells a later frame when the GPU
+   is done with it, so the CPU never overwrites data still being read and
+   the driver never has to synchronise behind our back.
+
+   Otherwise each write maps just its range unsynchronised, and when the
+   buffer is full it is orphaned with glBufferData(NULL) so the driver can
+   hand over fresh storage while the GPU finishes with the old. */
+struct StreamBuffer {
+    enum { REGIONS = 3, ALIGN = 16 };
+
+    bool allow_persistent;      // cleared by --no-persistent-map
+    bool persistent;
+    GLStateCache* gl;
+    GLuint buffer;
+    GLsizeiptr region_size;
+    int region;
+    GLintptr offset;            // next free byte, in the region when persistent
+    char* mapped;               // the whole buffer, when persistent
+    GLsync fences[REGIONS];
+    bool mapped_range;          // a fallback range is mapped and not yet unmapped
+    long long stalls, grows, orphans;
+
+    StreamBuffer () : allow_persistent(true), persistent(false), gl(NULL), buffer(0), region_size(0),
+                      region(0), offset(0), mapped(NULL), mapped_range(false), stalls(0), grows(0), orphans(0)
+    {
+        for (int r = 0; r < REGIONS; r++)
+            fences[r] = 0;
+    }
+
+    /* Needs a current GL context */
+    void init (GLStateCache& state, GLsizeiptr bytes_per_frame)
+    {
+        gl = &state;
+        persistent = allow_persistent && (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage);
+        glGenBuffers(1, &buffer);
+        allocate(bytes_per_frame);
+    }
+
+    void allocate (GLsizeiptr bytes_per_frame)
+    {
+        region_size = bytes_per_frame;
+        gl->bindArrayBuffer(buffer);
+        if (persistent) {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_ARRAY_BUFFER, REGIONS * region_size, NULL, flags);
+            mapped = (char*) glMapBufferRange(GL_ARRAY_BUFFER, 0, REGIONS * region_size, flags);
+        }
+        else
+            glBufferData(GL_ARRAY_BUFFER, REGIONS * region_size, NULL, GL_STREAM_DRAW);
+        offset = 0;
+    }
+
+    /* Replace the buffer with one that has room for 'bytes' in a frame. Waits
+       for the GPU to finish with the old one; only happens as peak load grows. */
+    void grow (GLsizeiptr bytes)
+    {
+        GLsizeiptr size = region_size;
+        while (size < bytes)
+            size *= 2;
+        glFinish();
+        for (int r = 0; r < REGIONS; r++)
+            if (fences[r]) {
+                glDeleteSync(fences[r]);
+                fences[r] = 0;
+            }
+        // buffer storage is immutable, so a bigger buffer is a new buffer
+        gl->bindArrayBuffer(0);
+        glDeleteBuffers(1, &buffer);
+        glGenBuffers(1, &buffer);
+        mapped = NULL;
+        region = 0;
+        allocate(size);
+        grows++;
+    }
+
+    /* Start of a frame - move to the next region once the GPU has let go of it */
+    void beginFrame ()
+    {
+        if (!persistent)
+            return;
+        region = (region + 1) % REGIONS;
+        offset = 0;
+        GLsync fence = fences[region];
+        if (!fence)
+            return;
+        if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+            stalls++;
+            while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED)
+                ;
+        }
+        glDeleteSync(fence);
+        fences[region] = 0;
+    }
+
+    /* Room for 'bytes' to write this frame; 'at' is where it lands in the
+       buffer. Draw from it before the next map(), which may move the
+       buffer. In fallback mode the range stays mapped until unmap(). */
+    void* map (GLsizeiptr bytes, GLintptr& at)
+    {
+        offset = (offset + ALIGN - 1) & ~(GLintptr) (ALIGN - 1);
+        if (persistent) {
+            if (offset + bytes > region_size)
+                grow(offset + bytes);
+            at = region * region_size + offset;
+            offset += bytes;
+            return mapped + at;
+        }
+        gl->bindArrayBuffer(buffer);
+        if (bytes > REGIONS * region_size)
+            grow(bytes);
+        else if (offset + bytes > REGIONS * region_size) {
+            glBufferData(GL_ARRAY_BUFFER, REGIONS * region_size, NULL, GL_STREAM_DRAW);
+            offset = 0;
+            orphans++;
+        }
+        at = offset;
+        offset += bytes;
+        mapped_range = true;
+        return glMapBufferRange(GL_ARRAY_BUFFER, at, bytes,
+                                GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    }
+
+    /* Done writing what map() returned; must come before drawing from it */
+    void unmap ()
+    {
+        if (!mapped_range)
+            return;
+        gl->bindArrayBuffer(buffer);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        mapped_range = false;
+    }
+
+    /* After the frame's last draw from the buffer */
+    void endFrame ()
+    {
+        if (persistent)
+            fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    void report (FILE* out) const
+    {
+        fprintf(out, "stream: %s, %lld KB x %d, %lld waits on the GPU, %lld grows, %lld orphans\n",
+                persistent ? "persistent" : "orphaning", (long long) region_size / 1024, (int) REGIONS,
+                stalls, grows, orphans);
+    }
+};
+
+#endif